@@ -64,6 +64,9 @@ typedef enum rr_section {
 
 #define TYPE_SUPPORT_MAX  6
 
+#define TYPE_OPT	41	/* EDNS0 pseudo RR, RFC6891, only read in queries */
+#define EDNS_OPT_CLIENT_SUBNET	8	/* RFC7871 */
+
 
 #define MAXLABELLEN	63
 #define MAXDOMAINLEN	255
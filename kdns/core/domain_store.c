@@ -17,8 +17,25 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <rte_hash.h>
+#include <rte_lcore.h>
 #include "view.h"
 #include "domain_store.h"
+#include "zone.h"
+
+#define RR_BATCH_SEEN	0	/* the rrs the rrset had before the batch are in the table */
+#define RR_BATCH_VIEW	1
+#define RR_BATCH_RDATA	2
+
+typedef struct rr_batch_slot {
+	rrset_type* rrset;	/* NULL for an empty slot */
+	uint32_t hash;
+	uint16_t view_id;
+	uint16_t rr_idx;
+	uint8_t kind;
+}rr_batch_slot_type;
+
+uint32_t domain_hash_entries = 262144;
 
 static domain_type *
 allocate_domain_info(domain_table_type* table,
@@ -28,7 +45,7 @@ allocate_domain_info(domain_table_type* table,
 	
 	domain_type *d;
 
-	d = (domain_type *) xalloc(sizeof(domain_type));
+	d = (domain_type *) slab_alloc(&table->domain_slab);
         d->dname = (domain_name_st*) domain_name_partial_copy(dname, domain_dname(parent)->label_count + 1);
 	d->parent = parent;
 	d->wildcard_child_closest_match = d;
@@ -36,7 +53,6 @@ allocate_domain_info(domain_table_type* table,
 	d->usage = 0;
 	d->is_existing = 0;
 	d->is_apex = 0;
-    d->compressed_offset =0;
     table->number_total++;
 	return d;
 }
@@ -57,6 +73,106 @@ domain_can_be_deleted(domain_type* domain)
 }
 
 
+static inline uint64_t
+domain_name_hash(const domain_name_st* dname)
+{
+	const uint8_t* p = domain_name_get(dname);
+	uint64_t h = 14695981039346656037ULL;
+	uint8_t i;
+
+	/* names are stored and queried lowercased, no normalizing here */
+	for (i = 0; i < dname->name_size; ++i) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static inline hash_sig_t
+domain_name_hash_sig(uint64_t key)
+{
+	return (hash_sig_t)(key ^ (key >> 32));
+}
+
+static void
+domain_hash_create(domain_table_type* table)
+{
+	char name[RTE_HASH_NAMESIZE];
+	struct rte_hash_parameters params = {
+		.entries = domain_hash_entries,
+		.key_len = sizeof(uint64_t),
+		.socket_id = rte_socket_id(),
+	};
+
+	table->namehash = NULL;
+	if (domain_hash_entries == 0)
+		return;
+	snprintf(name, sizeof(name), "dname_%p", table);
+	params.name = name;
+	table->namehash = rte_hash_create(&params);
+	if (table->namehash == NULL)
+		log_msg(LOG_ERR, "failed to create domain hash %s, lookup the radix tree only\n", name);
+}
+
+/* a name whose key collides with another stays in the radix tree only */
+static void
+domain_hash_add(domain_table_type* table, domain_type* domain)
+{
+	uint64_t key;
+	void* data;
+
+	if (table->namehash == NULL)
+		return;
+	key = domain_name_hash(domain->dname);
+	if (rte_hash_lookup_with_hash_data(table->namehash, &key,
+		domain_name_hash_sig(key), &data) >= 0)
+		return;
+	if (rte_hash_add_key_with_hash_data(table->namehash, &key,
+		domain_name_hash_sig(key), domain) < 0) {
+		static int full_logged;
+		if (!full_logged) {
+			full_logged = 1;
+			log_msg(LOG_ERR, "domain hash is full, the other names lookup the radix tree\n");
+		}
+	}
+}
+
+static void
+domain_hash_del(domain_table_type* table, domain_type* domain)
+{
+	uint64_t key;
+	void* data;
+
+	if (table->namehash == NULL)
+		return;
+	key = domain_name_hash(domain->dname);
+	if (rte_hash_lookup_with_hash_data(table->namehash, &key,
+		domain_name_hash_sig(key), &data) >= 0 && data == domain)
+		rte_hash_del_key_with_hash(table->namehash, &key,
+			domain_name_hash_sig(key));
+}
+
+static domain_type*
+domain_hash_find(domain_table_type* table, const domain_name_st* dname)
+{
+	uint64_t key;
+	void* data;
+	domain_type* domain;
+
+	if (table->namehash == NULL)
+		return NULL;
+	key = domain_name_hash(dname);
+	if (rte_hash_lookup_with_hash_data(table->namehash, &key,
+		domain_name_hash_sig(key), &data) < 0)
+		return NULL;
+	domain = (domain_type*)data;
+	if (domain_dname(domain)->name_size != dname->name_size ||
+		memcmp(domain_name_get(domain_dname(domain)),
+			domain_name_get(dname), dname->name_size) != 0)
+		return NULL;
+	return domain;
+}
+
 /** perform domain name deletion */
 static void
 do_deldomain(domain_store_type* db, domain_type* domain)
@@ -70,10 +186,11 @@ do_deldomain(domain_store_type* db, domain_type* domain)
 		domain->parent->wildcard_child_closest_match =
 			domain_previous_existing_child(domain);
 
+    domain_hash_del(db->domains, domain);
     radix_delete(db->domains->nametree, domain->rnode);
     db->domains->number_total--;
     free(domain_dname(domain));
-    free(domain);
+    slab_free(&db->domains->domain_slab, domain);
 }
 
 void
@@ -132,7 +249,7 @@ apex_rrset_checks( rrset_type* rrset, domain_type* domain)
 		zone->soa_rrset = rrset;
 
 		if(zone->soa_nx_rrset == 0) {
-			zone->soa_nx_rrset = xalloc(
+			zone->soa_nx_rrset = xalloc_zero(
 				sizeof(rrset_type));
 			zone->soa_nx_rrset->rr_count = 1;
 			zone->soa_nx_rrset->next = 0;
@@ -146,6 +263,7 @@ apex_rrset_checks( rrset_type* rrset, domain_type* domain)
 		if (rrset->rrs->ttl > ntohl(soa_minimum)) {
 			zone->soa_nx_rrset->rrs[0].ttl = ntohl(soa_minimum);
 		}
+		rrset_index_build(zone->soa_nx_rrset);
 	} 
 }
 
@@ -181,7 +299,6 @@ rrset_zero_nonexist_check(domain_type* domain, domain_type* ce)
 void
 rrset_delete(domain_store_type* db, domain_type* domain, rrset_type* rrset)
 {
-	(void)db;
 	int i;
 	/* find previous */
 	rrset_type** pp = &domain->rrsets;
@@ -204,8 +321,462 @@ rrset_delete(domain_store_type* db, domain_type* domain, rrset_type* rrset)
 	/* recycle the memory space of the rrset */
 	for (i = 0; i < rrset->rr_count; ++i)
 		add_rdata_to_recyclebin( &rrset->rrs[i]);
+	if (rrset->index_dirty) {
+		uint32_t j;
+		for (j = 0; j < db->dirty_num; ++j) {
+			if (db->dirty[j] == rrset)
+				db->dirty[j] = NULL;
+		}
+	}
+	domain_store_batch_forget(db);
+    free(rrset->views);
+    free(rrset->lb_sched);
     free(rrset->rrs);
-    free(rrset);
+    slab_free(&db->domains->rrset_slab, rrset);
+}
+
+/* room for num rrs, doubling so that adding n rrs one by one copies O(n) */
+void
+rrset_rrs_reserve(rrset_type* rrset, uint32_t num)
+{
+	uint32_t cap = rrset->rr_capacity;
+
+	if (num <= cap)
+		return;
+	if (cap == 0)
+		cap = 1;
+	while (cap < num)
+		cap <<= 1;
+	if (cap > 65535)
+		cap = 65535;
+	rrset->rrs = xrealloc(rrset->rrs, cap * sizeof(rr_type));
+	memset(&rrset->rrs[rrset->rr_capacity], 0, (cap - rrset->rr_capacity) * sizeof(rr_type));
+	rrset->rr_capacity = cap;
+}
+
+/* halve once a quarter is used, so add and delete at the edge do not thrash */
+void
+rrset_rrs_shrink(rrset_type* rrset)
+{
+	uint32_t cap = rrset->rr_capacity;
+
+	if (rrset->rr_count == 0 || rrset->rr_count > cap / 4)
+		return;
+	cap >>= 1;
+	rrset->rrs = xrealloc(rrset->rrs, cap * sizeof(rr_type));
+	rrset->rr_capacity = cap;
+}
+
+#define LB_SCHED_MAX_LEN  4096
+
+struct lb_pass {
+	uint64_t pass;
+	uint64_t stride;
+	uint16_t idx;
+};
+
+static inline int
+lb_pass_less(const struct lb_pass* a, const struct lb_pass* b)
+{
+	return a->pass < b->pass || (a->pass == b->pass && a->idx < b->idx);
+}
+
+static void
+lb_heap_down(struct lb_pass* heap, uint32_t num, uint32_t i)
+{
+	struct lb_pass tmp;
+	uint32_t min, l;
+
+	for (;;) {
+		min = i;
+		l = 2 * i + 1;
+		if (l < num && lb_pass_less(&heap[l], &heap[min]))
+			min = l;
+		if (l + 1 < num && lb_pass_less(&heap[l + 1], &heap[min]))
+			min = l + 1;
+		if (min == i)
+			return;
+		tmp = heap[i];
+		heap[i] = heap[min];
+		heap[min] = tmp;
+		i = min;
+	}
+}
+
+static uint32_t
+lb_gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/*
+ * Stride scheduling over the rrs in group: every pick takes the rr with
+ * the smallest pass and moves it on by 2^32/weight, so the picks of each
+ * rr are spread evenly over the schedule.  O(len log num).
+ */
+static uint32_t
+lb_sched_fill(rrset_type* rrset, uint16_t* group, uint32_t num, uint16_t** sched, uint32_t off)
+{
+	struct lb_pass* heap = xalloc_array_zero(num, sizeof(struct lb_pass));
+	uint32_t i, g = 0, total = 0, len = 0;
+
+	for (i = 0; i < num; ++i) {
+		uint32_t w = rrset->rrs[group[i]].lb_weight ? rrset->rrs[group[i]].lb_weight : 1;
+		heap[i].stride = w;
+		heap[i].idx = group[i];
+		total += w;
+		g = lb_gcd(w, g);
+	}
+	for (i = 0; i < num; ++i) {
+		uint64_t w = heap[i].stride / g;
+		/* keep big pools bounded, every rr still gets one slot */
+		if (total / g > LB_SCHED_MAX_LEN) {
+			w = w * LB_SCHED_MAX_LEN / (total / g);
+			if (w == 0)
+				w = 1;
+		}
+		heap[i].stride = (1ULL << 32) / w;
+		heap[i].pass = heap[i].stride / 2;
+		len += w;
+	}
+	for (i = num / 2; i-- > 0; )
+		lb_heap_down(heap, num, i);
+
+	*sched = xrealloc(*sched, (off + len) * sizeof(uint16_t));
+	for (i = 0; i < len; ++i) {
+		(*sched)[off + i] = heap[0].idx;
+		heap[0].pass += heap[0].stride;
+		lb_heap_down(heap, num, 0);
+	}
+	free(heap);
+	return len;
+}
+
+static const uint32_t lb_maglev_sizes[] = {251, 1021, 4093, 16381, 65521};
+
+/* identify the rr by its rdata, so a rr keeps its table slots when others come and go */
+static uint32_t
+lb_rr_hash(rr_type* rr, uint32_t seed)
+{
+	uint32_t h = 2166136261U ^ seed;
+	const uint8_t *data;
+	size_t size, j;
+	uint16_t i;
+
+	for (i = 0; i < rr->rdata_count; ++i) {
+		/* the target of srv, cname and ptr by its wire name */
+		if (rdata_atom_is_domain(rr->type, i)) {
+			const domain_name_st *dname = domain_dname(rdata_atom_domain(rr->rdatas[i]));
+			data = domain_name_get(dname);
+			size = dname->name_size;
+		} else {
+			data = rdata_atomdata(rr->rdatas[i]);
+			size = rdata_atom_size(rr->rdatas[i]);
+		}
+		for (j = 0; j < size; ++j) {
+			h ^= data[j];
+			h *= 16777619U;
+		}
+	}
+	return h;
+}
+
+/*
+ * Maglev lookup table: every rr walks its own permutation of the slots
+ * and the rrs take turns claiming the next free one.  A membership change
+ * moves about 1/num of the slots.
+ */
+static uint32_t
+lb_maglev_fill(rrset_type* rrset, uint16_t* group, uint32_t num, uint16_t** sched, uint32_t off)
+{
+	uint64_t *perm = xalloc_array_zero(num * 3, sizeof(uint64_t));
+	uint32_t size = lb_maglev_sizes[0], i, filled = 0;
+	uint8_t *used;
+	uint16_t *table;
+
+	for (i = 0; i < sizeof(lb_maglev_sizes) / sizeof(lb_maglev_sizes[0]); ++i) {
+		size = lb_maglev_sizes[i];
+		if (size >= num * 100)
+			break;
+	}
+	for (i = 0; i < num; ++i) {
+		perm[3 * i] = lb_rr_hash(&rrset->rrs[group[i]], 0) % size;
+		perm[3 * i + 1] = lb_rr_hash(&rrset->rrs[group[i]], 0x9e3779b9U) % (size - 1) + 1;
+	}
+
+	used = xalloc_zero(size);
+	*sched = xrealloc(*sched, (off + size) * sizeof(uint16_t));
+	table = *sched + off;
+	while (filled < size) {
+		for (i = 0; i < num && filled < size; ++i) {
+			uint32_t c;
+			do {
+				c = (perm[3 * i] + perm[3 * i + 2] * perm[3 * i + 1]) % size;
+				perm[3 * i + 2]++;
+			} while (used[c]);
+			table[c] = group[i];
+			used[c] = 1;
+			filled++;
+		}
+	}
+	free(used);
+	free(perm);
+	return size;
+}
+
+/* wrr schedule or maglev table for the views that use them, one segment per view */
+static void
+rrset_lb_build(rrset_type* rrset)
+{
+	uint16_t *sched = NULL, *group;
+	uint32_t sched_len = 0, len, num;
+	uint16_t i, j;
+
+	free(rrset->lb_sched);
+	rrset->lb_sched = NULL;
+
+	group = xalloc_array_zero(rrset->rr_count, sizeof(uint16_t));
+	for (i = 0; i < rrset->view_count; ++i) {
+		rrset_view_type *view = &rrset->views[i];
+		uint16_t lb_mode = rrset->rrs[view->start].lb_mode;
+		if (lb_mode != DOMAIN_LB_WRR && lb_mode != DOMAIN_LB_MAGLEV)
+			continue;
+
+		/* only the rrs that are up get slots, unless all of them are down */
+		num = view->up ? view->up : view->count;
+		for (j = 0; j < num; ++j)
+			group[j] = view->start + j;
+		if (lb_mode == DOMAIN_LB_WRR)
+			len = lb_sched_fill(rrset, group, num, &sched, sched_len);
+		else
+			len = lb_maglev_fill(rrset, group, num, &sched, sched_len);
+		for (j = 0; j < view->count; ++j) {
+			rrset->rrs[view->start + j].lb_sched_off = sched_len;
+			rrset->rrs[view->start + j].lb_sched_len = len;
+		}
+		sched_len += len;
+	}
+	free(group);
+	rrset->lb_sched = sched;
+}
+
+static inline int
+rr_view_order(rr_type* a, rr_type* b)
+{
+	if (a->view_id != b->view_id)
+		return a->view_id < b->view_id ? -1 : 1;
+	return (int)a->disabled - (int)b->disabled;
+}
+
+void
+rrset_index_update(domain_store_type* db, rrset_type* rrset)
+{
+	if (db->batch == 0) {
+		rrset_index_build(rrset);
+		return;
+	}
+	if (rrset->index_dirty)
+		return;
+	if (db->dirty_num == db->dirty_cap) {
+		db->dirty_cap = db->dirty_cap ? db->dirty_cap * 2 : 64;
+		db->dirty = xrealloc(db->dirty, db->dirty_cap * sizeof(rrset_type*));
+	}
+	rrset->index_dirty = 1;
+	db->dirty[db->dirty_num++] = rrset;
+}
+
+void
+domain_store_batch_begin(domain_store_type* db)
+{
+	db->batch++;
+}
+
+void
+domain_store_batch_end(domain_store_type* db)
+{
+	uint32_t i;
+
+	if (--db->batch > 0)
+		return;
+	for (i = 0; i < db->dirty_num; ++i) {
+		if (db->dirty[i] == NULL)
+			continue;
+		db->dirty[i]->index_dirty = 0;
+		rrset_index_build(db->dirty[i]);
+	}
+	db->dirty_num = 0;
+	domain_store_batch_forget(db);
+}
+
+void
+domain_store_batch_forget(domain_store_type* db)
+{
+	free(db->rr_slots);
+	db->rr_slots = NULL;
+	db->rr_slot_num = 0;
+	db->rr_slot_cap = 0;
+}
+
+static inline uint32_t
+rr_batch_slot_of(domain_store_type* db, const rrset_type* rrset, uint8_t kind, uint16_t view_id, uint32_t hash)
+{
+	uint64_t key = (uint64_t)(uintptr_t)rrset ^ ((uint64_t)hash << 32) ^ ((uint32_t)view_id << 8) ^ kind;
+	return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (db->rr_slot_cap - 1);
+}
+
+static void
+rr_batch_insert(domain_store_type* db, rrset_type* rrset, uint8_t kind, uint16_t view_id, uint32_t hash, uint16_t rr_idx)
+{
+	rr_batch_slot_type* slot;
+	uint32_t i;
+
+	/* kept at most half full, grown by doubling */
+	if ((db->rr_slot_num + 1) * 2 > db->rr_slot_cap) {
+		rr_batch_slot_type* old = db->rr_slots;
+		uint32_t old_cap = db->rr_slot_cap;
+		db->rr_slot_cap = old_cap ? old_cap * 2 : 1024;
+		db->rr_slots = xalloc_array_zero(db->rr_slot_cap, sizeof(rr_batch_slot_type));
+		for (i = 0; i < old_cap; ++i) {
+			if (old[i].rrset == NULL)
+				continue;
+			uint32_t j = rr_batch_slot_of(db, old[i].rrset, old[i].kind, old[i].view_id, old[i].hash);
+			while (db->rr_slots[j].rrset != NULL)
+				j = (j + 1) & (db->rr_slot_cap - 1);
+			db->rr_slots[j] = old[i];
+		}
+		free(old);
+	}
+	i = rr_batch_slot_of(db, rrset, kind, view_id, hash);
+	while (db->rr_slots[i].rrset != NULL)
+		i = (i + 1) & (db->rr_slot_cap - 1);
+	slot = &db->rr_slots[i];
+	slot->rrset = rrset;
+	slot->kind = kind;
+	slot->view_id = view_id;
+	slot->hash = hash;
+	slot->rr_idx = rr_idx;
+	db->rr_slot_num++;
+}
+
+/* the next slot of the key from *pos on, NULL when there is none */
+static rr_batch_slot_type*
+rr_batch_next(domain_store_type* db, uint32_t* pos, rrset_type* rrset, uint8_t kind, uint16_t view_id, uint32_t hash)
+{
+	rr_batch_slot_type* slot;
+
+	while ((slot = &db->rr_slots[*pos])->rrset != NULL) {
+		*pos = (*pos + 1) & (db->rr_slot_cap - 1);
+		if (slot->rrset == rrset && slot->kind == kind && slot->view_id == view_id && slot->hash == hash)
+			return slot;
+	}
+	return NULL;
+}
+
+static rr_batch_slot_type*
+rr_batch_find(domain_store_type* db, rrset_type* rrset, uint8_t kind, uint16_t view_id, uint32_t hash)
+{
+	uint32_t pos;
+
+	if (db->rr_slots == NULL)
+		return NULL;
+	pos = rr_batch_slot_of(db, rrset, kind, view_id, hash);
+	return rr_batch_next(db, &pos, rrset, kind, view_id, hash);
+}
+
+/* the rrs an rrset had before its first add of the batch */
+static void
+rrset_batch_seed(domain_store_type* db, rrset_type* rrset)
+{
+	uint16_t i;
+
+	if (rr_batch_find(db, rrset, RR_BATCH_SEEN, 0, 0) != NULL)
+		return;
+	rr_batch_insert(db, rrset, RR_BATCH_SEEN, 0, 0, 0);
+	for (i = 0; i < rrset->rr_count; ++i)
+		rrset_batch_add_rr(db, rrset, i);
+}
+
+void
+rrset_batch_add_rr(domain_store_type* db, rrset_type* rrset, uint16_t rr_idx)
+{
+	rr_type* rr = &rrset->rrs[rr_idx];
+
+	if (rr_batch_find(db, rrset, RR_BATCH_VIEW, rr->view_id, 0) == NULL)
+		rr_batch_insert(db, rrset, RR_BATCH_VIEW, rr->view_id, 0, rr_idx);
+	rr_batch_insert(db, rrset, RR_BATCH_RDATA, rr->view_id, lb_rr_hash(rr, 0), rr_idx);
+}
+
+rr_type*
+rrset_batch_find_view(domain_store_type* db, rrset_type* rrset, uint16_t view_id)
+{
+	rr_batch_slot_type* slot;
+
+	rrset_batch_seed(db, rrset);
+	slot = rr_batch_find(db, rrset, RR_BATCH_VIEW, view_id, 0);
+	return slot ? &rrset->rrs[slot->rr_idx] : NULL;
+}
+
+int
+rrset_batch_find_rr(domain_store_type* db, rrset_type* rrset, rr_type* rr)
+{
+	rr_batch_slot_type* slot;
+	uint32_t hash, pos;
+
+	rrset_batch_seed(db, rrset);
+	hash = lb_rr_hash(rr, 0);
+	pos = rr_batch_slot_of(db, rrset, RR_BATCH_RDATA, rr->view_id, hash);
+	while ((slot = rr_batch_next(db, &pos, rrset, RR_BATCH_RDATA, rr->view_id, hash)) != NULL) {
+		if (!zrdatacmp(rr->type, rr, &rrset->rrs[slot->rr_idx]))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Rebuild the per view index after the rrs or their state changed: the
+ * rrs are sorted by view and up first, so a query answers a slice.
+ */
+void
+rrset_index_build(rrset_type* rrset)
+{
+	rr_type tmp;
+	uint16_t i, j, num = 0;
+
+	/* insertion sort, stable and the array is mostly sorted already */
+	for (i = 1; i < rrset->rr_count; ++i) {
+		if (rr_view_order(&rrset->rrs[i - 1], &rrset->rrs[i]) <= 0)
+			continue;
+		tmp = rrset->rrs[i];
+		for (j = i; j > 0 && rr_view_order(&rrset->rrs[j - 1], &tmp) > 0; --j)
+			rrset->rrs[j] = rrset->rrs[j - 1];
+		rrset->rrs[j] = tmp;
+	}
+
+	for (i = 0; i < rrset->rr_count; ++i) {
+		if (i == 0 || rrset->rrs[i].view_id != rrset->rrs[i - 1].view_id)
+			num++;
+	}
+	free(rrset->views);
+	rrset->views = xalloc_array_zero(num ? num : 1, sizeof(rrset_view_type));
+	rrset->view_count = num;
+	for (i = 0, num = 0; i < rrset->rr_count; ++i) {
+		rrset_view_type *view = &rrset->views[num];
+		if (i > 0 && rrset->rrs[i].view_id != rrset->rrs[i - 1].view_id)
+			view = &rrset->views[++num];
+		if (view->count == 0) {
+			view->view_id = rrset->rrs[i].view_id;
+			view->start = i;
+		}
+		view->count++;
+		if (!rrset->rrs[i].disabled)
+			view->up++;
+	}
+	rrset_lb_build(rrset);
 }
 
 
@@ -256,9 +827,13 @@ domain_table_create(void)
 	result = (domain_table_type *) xalloc(
 						    sizeof(domain_table_type));
 
+    slab_init(&result->domain_slab, "domain_slab", sizeof(domain_type), DOMAIN_SLAB_OBJ_NUM);
+    slab_init(&result->rrset_slab, "rrset_slab", sizeof(rrset_type), DOMAIN_SLAB_OBJ_NUM);
     result->nametree = radix_tree_create();
     root->rnode = radomain_name_insert(result->nametree, domain_name_get(root->dname),
             root->dname->name_size, root);
+    domain_hash_create(result);
+    domain_hash_add(result, root);
 
 
     result->number_total = 1;
@@ -282,6 +857,11 @@ domain_table_search(domain_table_type *table,
 	assert(closest_match);
 	assert(closest_encloser);
 
+	*closest_match = domain_hash_find(table, dname);
+	if (*closest_match) {
+		*closest_encloser = *closest_match;
+		return 1;
+	}
 
     exact = radomain_name_find_less_equal(table->nametree, domain_name_get(dname),
             dname->name_size, (struct radnode**)closest_match);
@@ -347,6 +927,7 @@ domain_table_insert(domain_table_type* table,
 			result->rnode = radomain_name_insert(table->nametree,
 				domain_name_get(result->dname),
 				result->dname->name_size, result);
+			domain_hash_add(table, result);
 
 			/*
 			 * If the newly added domain name is larger
@@ -14,8 +14,15 @@
 #include "kdns.h"
 
 #include "radtree.h"
+#include "slab.h"
 
 struct kdns;
+struct rte_hash;
+
+#define DOMAIN_LB_RR    1
+#define DOMAIN_LB_WRR   2
+#define DOMAIN_LB_HASH  3
+#define DOMAIN_LB_MAGLEV 4
 
 typedef struct domain
 {
@@ -26,7 +33,6 @@ typedef struct domain
 	struct domain* wildcard_child_closest_match;
 	struct rrset * rrsets;
 	size_t     usage;     
-    uint16_t    compressed_offset;
     uint32_t maxAnswer;
 	unsigned     is_existing : 1;
 	unsigned     is_apex : 1;
@@ -50,6 +56,7 @@ typedef struct rr {
 	struct domain *     owner;
 	union rdata_atom* rdatas;
 	char  view_name[MAX_VIEW_NAME_LEN];
+	uint16_t         view_id;
 	uint32_t         ttl;
 	uint16_t         type;
 	uint16_t         klass;
@@ -57,19 +64,37 @@ typedef struct rr {
 	
 	uint16_t         lb_mode;
 	uint16_t         lb_weight;
-	uint16_t         lb_weight_cur;
+	uint8_t          disabled;  /* down by health check, not answered */
+	/* wrr schedule or maglev table of the rrs in the same view, in rrset->lb_sched */
+	uint32_t         lb_sched_off;
+	uint32_t         lb_sched_len;
 }rr_type;
 
+/* the rrs of one view, rrs[start, start + up) are up and the rest are down */
+typedef struct rrset_view
+{
+	uint16_t view_id;
+	uint16_t start;
+	uint16_t count;
+	uint16_t up;
+	uint32_t lb_pos;	/* rotation of the rr and wrr modes, each lcore has its own store */
+}rrset_view_type;
+
 /*
  * An RRset consists of at least one RR.  All RRs are from the same
- * zone.
+ * zone.  The rrs are kept sorted by view id.
  */
 typedef struct rrset
 {
 	struct rrset* next;
 	struct zone*  zone;
 	struct rr*    rrs;
+	struct rrset_view* views;
+	uint16_t*   lb_sched;  /* rr indexes for the wrr and maglev modes, built on update */
 	uint16_t    rr_count;
+	uint16_t    rr_capacity;  /* rrs grows by doubling, see rrset_rrs_reserve */
+	uint16_t    view_count;
+	uint8_t     index_dirty;  /* queued for rrset_index_build at batch end */
 }rrset_type;
 
 typedef union rdata_atom
@@ -80,19 +105,37 @@ typedef union rdata_atom
 	uint16_t*    data;
 }rdata_atom_type;
 
+/* exact names are looked up in namehash first, keyed by a 64 bit hash of the wire name */
 typedef struct domain_table
 {
     struct radtree *nametree;
+    struct rte_hash *namehash;
 	struct domain* root;
     size_t     number_total; 
+    struct slab domain_slab;
+    struct slab rrset_slab;
 }domain_table_type;
 
+#define DOMAIN_SLAB_OBJ_NUM 4096
+
+/* capacity of namehash, 0 disables it */
+extern uint32_t domain_hash_entries;
+
 
 typedef struct  domain_store
 {
 	struct domain_table* domains;
 	struct radtree*    zonetree;
 	struct view_tree* viewtree;
+	/* rrsets updated inside a batch are indexed once when it ends */
+	uint32_t batch;
+	struct rrset** dirty;
+	uint32_t dirty_num;
+	uint32_t dirty_cap;
+	/* the rrs added inside a batch by rdata hash, see rrset_batch_find_rr */
+	struct rr_batch_slot* rr_slots;
+	uint32_t rr_slot_num;
+	uint32_t rr_slot_cap;
 }domain_store_type;
 
 
@@ -122,6 +165,21 @@ domain_table_count(domain_table_type* table)
 void rrset_lower_usage(domain_store_type* db, rrset_type* rrset);
 void rrset_delete(domain_store_type* db, domain_type* domain, rrset_type* rrset);
 void rr_lower_usage(domain_store_type* db, rr_type* rr);
+void rrset_index_build(rrset_type* rrset);
+void rrset_index_update(domain_store_type* db, rrset_type* rrset);
+void rrset_rrs_reserve(rrset_type* rrset, uint32_t num);
+void rrset_rrs_shrink(rrset_type* rrset);
+void domain_store_batch_begin(domain_store_type* db);
+void domain_store_batch_end(domain_store_type* db);
+/*
+ * Inside a batch an add to a large rrset is checked by hash instead of
+ * against every rr.  The rrs of a view keep their ttl and lb_mode, so any
+ * rr of the view stands for all of them.  A delete drops the table.
+ */
+rr_type* rrset_batch_find_view(domain_store_type* db, rrset_type* rrset, uint16_t view_id);
+int rrset_batch_find_rr(domain_store_type* db, rrset_type* rrset, rr_type* rr);
+void rrset_batch_add_rr(domain_store_type* db, rrset_type* rrset, uint16_t rr_idx);
+void domain_store_batch_forget(domain_store_type* db);
 void add_rdata_to_recyclebin( rr_type* rr);
 domain_type* rrset_zero_nonexist_check(domain_type* domain, domain_type* ce);
 
@@ -269,6 +327,19 @@ rdata_atom_wireformat_type(uint16_t type, size_t index)
 	return (rdata_wireformat_type) descriptor->wireformat[index];
 }
 
+static inline rrset_view_type *
+rrset_find_view(rrset_type* rrset, uint16_t view_id)
+{
+	uint16_t i;
+	if (view_id == VIEW_ID_NONE)
+		return NULL;
+	for (i = 0; i < rrset->view_count; ++i) {
+		if (rrset->views[i].view_id == view_id)
+			return &rrset->views[i];
+	}
+	return NULL;
+}
+
 static inline uint16_t
 rrset_rrtype(rrset_type* rrset)
 {
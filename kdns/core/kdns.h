@@ -16,11 +16,10 @@
 
 #define DEFAULT_VIEW_NAME "no_info"
 #define MAX_VIEW_NAME_LEN 32
-#define VIEW_MATCH_DEF   0
-#define VIEW_MATCH_NAME  1
-#define VIEW_MATCH_NONE  2
-// max match 128 rrs
-#define VIEW_MATCH_MAX_NUM  1024
+/* view names are interned to ids, the default view is 0 */
+#define VIEW_ID_DEFAULT  0
+#define VIEW_ID_NONE     0xffff
+#define VIEW_ID_MAX      4096
 
 /*  configuration and run-time variables */
 typedef struct kdns kdns_type;
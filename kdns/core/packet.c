@@ -12,28 +12,25 @@
 #include "query.h"
 #include "zone.h"
 
-#define DOMAIN_LB_RR    1
-#define DOMAIN_LB_WRR   2
-#define DOMAIN_LB_HASH  3
-
 int round_robin = 1;
+/* answer the disabled rrs when all of them are down */
+int all_down_fallback = 1;
 
 
 
 static void
 do_dname_data_encode(kdns_query_st *q, domain_type *domain)
 {
-	while (domain->parent && domain->compressed_offset == 0) {
-		domain->compressed_offset =  buffer_get_position(q->packet);
-        q->compressed_dnames[q->compressed_count] = domain;
-        q->compressed_count++;
-        
+	uint16_t offset = 0;
+
+	while (domain->parent && (offset = query_compress_find(q, domain)) == 0) {
+		query_compress_add(q, domain, buffer_get_position(q->packet));
 		buffer_write(q->packet, domain_name_get(domain_dname(domain)),
 			     label_length(domain_name_get(domain_dname(domain))) + 1U);
 		domain = domain->parent;
 	}
 	if (domain->parent) {
-		buffer_write_u16(q->packet,0xc000 | domain->compressed_offset);
+		buffer_write_u16(q->packet,0xc000 | offset);
 	} else {
 		buffer_write_u8(q->packet, 0);
 	}
@@ -93,45 +90,38 @@ packet_encode_rr(kdns_query_st *q, domain_type *owner, rr_type *rr, uint32_t ttl
 		return 1;
 	} else {
 		buffer_set_position(q->packet, truncation_mark);
-       // query_clear_dname_offsets(q, truncation_mark);
+		query_compress_rollback(q, truncation_mark);
 		return 0;
 	}
 }
 
+/* the client subnet of ECS when the query carries one, else the source address */
+static inline uint32_t lb_client_key(kdns_query_st *query) {
+    return query->has_ecs ? query->ecs_key : query->sip;
+}
+
 static int lb_filter(kdns_query_st *query,domain_type *owner,int16_t lb_mode, rrset_type *rrset,
-                    int16_t *idx_array, int16_t size,uint16_t round_robin_off){
+                    rrset_view_type *view, rr_type *rrs, uint16_t size){
 
     rr_type *rr_to_encode = NULL;
-    int16_t fit_rr_idx =0;
+    uint16_t fit_rr_idx = rrs - rrset->rrs;
 
     if (lb_mode == DOMAIN_LB_RR){
-        fit_rr_idx = idx_array[round_robin_off %size];       
+        fit_rr_idx += view->lb_pos++ % size;
     }else if (lb_mode == DOMAIN_LB_HASH){
-        fit_rr_idx = idx_array[query->sip %size];       
+        fit_rr_idx += lb_client_key(query) % size;
     }else if (lb_mode == DOMAIN_LB_WRR){
-        int16_t i;
-        int16_t find =0;
-        rr_type *rr;
-wrr_retry:
-
-        for( i =0; i<size; i++){
-            rr = &rrset->rrs[idx_array[i]];  
-            if (rr->lb_weight_cur >0){   
-                fit_rr_idx =  idx_array[i];
-                rr->lb_weight_cur--;
-                find =1;
-                break;
-            }  
+        rr_type *rr = &rrs[0];
+        if (rrset->lb_sched != NULL && rr->lb_sched_len > 0) {
+            const uint16_t *sched = rrset->lb_sched + rr->lb_sched_off;
+            fit_rr_idx = sched[view->lb_pos++ % rr->lb_sched_len];
         }
-        //no find rebuild lb_weight_cur
-        if (!find){     
-            for( i =0; i<size; i++){
-              rr = &rrset->rrs[idx_array[i]];  
-              rr->lb_weight_cur = rr->lb_weight;      
-            }  
-            goto wrr_retry;
+    }else if (lb_mode == DOMAIN_LB_MAGLEV){
+        rr_type *rr = &rrs[0];
+        if (rrset->lb_sched != NULL && rr->lb_sched_len > 0) {
+            uint32_t hash = (uint32_t)((lb_client_key(query) * 0x9E3779B97F4A7C15ULL) >> 32);
+            fit_rr_idx = rrset->lb_sched[rr->lb_sched_off + hash % rr->lb_sched_len];
         }
-            
     }else{
         log_msg(LOG_ERR,"lb_filter() lb_mode = %d \n",lb_mode);
         return 0;
@@ -153,15 +143,9 @@ packet_encode_rrset(kdns_query_st *query, domain_type *owner,
 {
 	uint16_t i;
 	uint16_t added = 0;  
-	static uint16_t round_robin_off = 0;
 	int do_robin = (round_robin && section == ANSWER_SECTION);
 	uint16_t start;
     uint32_t maxAnswer = 65535;
-    // max 128 record per view
-    int16_t rrs_view_idx[VIEW_MATCH_MAX_NUM];
-    int16_t rrs_def_idx[VIEW_MATCH_MAX_NUM];
-    int16_t view_match_num = 0;
-    int16_t def_match_num = 0;
     rr_type *rr_to_encode = NULL;
     
     int truncate_rrset = (section == ANSWER_SECTION ||
@@ -175,52 +159,32 @@ packet_encode_rrset(kdns_query_st *query, domain_type *owner,
 	assert(rrset->rr_count > 0);
     size_t truncation_mark = buffer_get_position(query->packet);
 
-    round_robin_off++;
-
-    // filter the view info
-    int ret_tmp;
-    uint16_t lb_mode = 0;
-	for (i = 0; i < rrset->rr_count; ++i) {
-        ret_tmp = check_view_info(query,&rrset->rrs[i]);
-        if ((ret_tmp == VIEW_MATCH_NAME)&& (view_match_num < VIEW_MATCH_MAX_NUM)){
-            if (lb_mode ==0) {
-                lb_mode = rrset->rrs[i].lb_mode;
-            }
-            rrs_view_idx[view_match_num] = i;
-            ++view_match_num;
-        }else if ((ret_tmp == VIEW_MATCH_DEF)&& (def_match_num < VIEW_MATCH_MAX_NUM)){
-            if (lb_mode ==0) {
-                lb_mode = rrset->rrs[i].lb_mode;
-            }
-            rrs_def_idx[def_match_num] = i;
-            ++def_match_num;
-        }
+    // the view slice, all of it when every rr is down
+	uint16_t match_num = 0;
+	rrset_view_type *view = rrset_view_slice(query, rrset, 0);
+	if (view != NULL) {
+		match_num = view->up;
+	} else if (all_down_fallback && (view = rrset_view_slice(query, rrset, 1)) != NULL) {
+		match_num = view->count;
 	}
-	int16_t match_num = 0;
-	int16_t *rrs_idx = NULL;
-	if (view_match_num) {
-		match_num = view_match_num;
-		rrs_idx = rrs_view_idx;
-	} else if (def_match_num) {
-		match_num = def_match_num;
-		rrs_idx = rrs_def_idx;
-	} else {
+	if (match_num == 0) {
 		return 0;
 	}
+	rr_type *rrs = &rrset->rrs[view->start];
 
     // lb enable
-    if (lb_mode != 0){
-        return lb_filter(query, owner, lb_mode, rrset, rrs_idx, match_num, round_robin_off);
+    if (rrs[0].lb_mode != 0){
+        return lb_filter(query, owner, rrs[0].lb_mode, rrset, view, rrs, match_num);
     }
     
     // lb_mode ==0 
 	if (do_robin) {
-		start = (uint16_t)(round_robin_off % match_num);
+		start = (uint16_t)(view->lb_pos++ % match_num);
 	} else {
 		start = 0;
 	}
     for (i = start; i < match_num && added < maxAnswer; ++i) {
-        rr_to_encode = &rrset->rrs[rrs_idx[i]];
+        rr_to_encode = &rrs[i];
 		if (packet_encode_rr(query, owner,rr_to_encode,rr_to_encode->ttl)) {
 			++added;
 		} else {
@@ -229,7 +193,7 @@ packet_encode_rrset(kdns_query_st *query, domain_type *owner,
 		}
 	}
 	for (i = 0; i < start && added < maxAnswer; ++i) {
-		rr_to_encode = &rrset->rrs[rrs_idx[i]];
+		rr_to_encode = &rrs[i];
 		if (packet_encode_rr(query, owner,rr_to_encode,rr_to_encode->ttl)) {
 			++added;
 		} else {
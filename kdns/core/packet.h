@@ -17,6 +17,8 @@
 
 struct query;
 
+extern int all_down_fallback;
+
 
 /*
  *
@@ -84,6 +84,7 @@ query_create(void)
             free(query);
             return NULL;
         }
+        query->compress_gen = 1;
     }
     return query;
 }
@@ -105,9 +106,12 @@ query_reset(kdns_query_st *q )
     q->maxAnswer = 0;
     q->offset = 0;
     q->sip = 0 ;
+    q->ecs_key = 0;
+    q->has_ecs = 0;
     q->cname_count = 0;
     q->maxMsgLen= UDP_MAX_MESSAGE_LEN;
-    memset(q->view_name,0,MAX_VIEW_NAME_LEN);
+    q->view_id = VIEW_ID_NONE;
+    query_compress_clear(q);
     q->answer.rrset_count = 0;
 }
 
@@ -130,6 +134,62 @@ process_query_section(kdns_query_st *query)
 	return 1;
 }
 
+/*
+ * Pick the client subnet out of the OPT record following the question.
+ * Only the hash lb modes use it, a malformed OPT is ignored.
+ */
+static void
+process_edns_section(kdns_query_st *query)
+{
+	buffer_st *packet = query->packet;
+	size_t end;
+	uint16_t rdlen, code, len, family, i;
+	uint8_t prefix, byte;
+	uint32_t key;
+
+	if (GET_AR_COUNT(packet) != 1 || !buffer_available(packet, 11))
+		return;
+	if (buffer_read_u8(packet) != 0 || buffer_read_u16(packet) != TYPE_OPT)
+		return;
+	/* udp payload size, extended rcode and flags */
+	buffer_skip(packet, 6);
+	rdlen = buffer_read_u16(packet);
+	if (!buffer_available(packet, rdlen))
+		return;
+	end = buffer_get_position(packet) + rdlen;
+
+	while (buffer_get_position(packet) + 4 <= end) {
+		code = buffer_read_u16(packet);
+		len = buffer_read_u16(packet);
+		if (buffer_get_position(packet) + len > end)
+			return;
+		if (code != EDNS_OPT_CLIENT_SUBNET) {
+			buffer_skip(packet, len);
+			continue;
+		}
+		if (len < 4)
+			return;
+		family = buffer_read_u16(packet);
+		prefix = buffer_read_u8(packet);
+		buffer_skip(packet, 1);
+		len -= 4;
+		if ((family != 1 || prefix > 32) && (family != 2 || prefix > 128))
+			return;
+		if (len != (prefix + 7) / 8)
+			return;
+		key = 2166136261U ^ family;
+		for (i = 0; i < len; ++i) {
+			byte = buffer_read_u8(packet);
+			if (i == len - 1 && (prefix & 7))
+				byte &= 0xff << (8 - (prefix & 7));
+			key = (key ^ byte) * 16777619U;
+		}
+		query->ecs_key = key;
+		query->has_ecs = 1;
+		return;
+	}
+}
+
 
 static void
 add_additional_rrsets(struct query *query, kdns_answer_st *answer,
@@ -137,42 +197,19 @@ add_additional_rrsets(struct query *query, kdns_answer_st *answer,
 		      struct additional_rr_types types[])
 {
 	int i;
-	int ret;
-	int16_t match_num = 0;
-	int16_t view_match_num = 0;
-	int16_t def_match_num = 0;
-	int16_t *rrs_idx = NULL;
-	// max 128 record per view
-	int16_t view_rrs_idx[VIEW_MATCH_MAX_NUM];
-	int16_t def_rrs_idx[VIEW_MATCH_MAX_NUM];
+	uint16_t match_num = 0;
+	rr_type *rrs;
 
 	assert(query);
 	assert(answer);
 	assert(master_rrset);
 	assert(rdata_atom_is_domain(rrset_rrtype(master_rrset), rdata_index));
 
-	// filter the view info
-	for (i = 0; i < master_rrset->rr_count; ++i) {
-		ret = check_view_info(query, &master_rrset->rrs[i]);
-		if (ret == VIEW_MATCH_NAME && view_match_num < VIEW_MATCH_MAX_NUM) {
-			view_rrs_idx[view_match_num++] = i;
-		} else if (ret == VIEW_MATCH_DEF && def_match_num < VIEW_MATCH_MAX_NUM) {
-			def_rrs_idx[def_match_num++] = i;
-		}
-	}
-	if (view_match_num) {
-		match_num = view_match_num;
-		rrs_idx = view_rrs_idx;
-	} else if (def_match_num) {
-		match_num = def_match_num;
-		rrs_idx = def_rrs_idx;
-	} else {
-		return;
-	}
+	rrs = rrset_view_rrs(query, master_rrset, 0, &match_num);
 
     for (i = 0; i < match_num; ++i) {
 		int j;
-		domain_type *additional = rdata_atom_domain(master_rrset->rrs[rrs_idx[i]].rdatas[rdata_index]);
+		domain_type *additional = rdata_atom_domain(rrs[i].rdatas[rdata_index]);
 		domain_type *match = additional;
 
 		assert(additional);
@@ -193,7 +230,6 @@ add_additional_rrsets(struct query *query, kdns_answer_st *answer,
 			temp->parent = match;
 			temp->wildcard_child_closest_match = temp;
 			temp->rrsets = wildcard_child->rrsets;
-			temp->compressed_offset = DNS_HEAD_SIZE;
 			temp->is_existing = wildcard_child->is_existing;
 			additional = temp;
 		}
@@ -277,27 +313,12 @@ answer_domain(struct kdns*  kdns, struct query *q, kdns_answer_st *answer,
 		assert(rrset->rr_count > 0);
 		if (added) {
 			/* only process first CNAME record */
-			int i, ret;
-			int16_t view_match_idx = -1;
-			int16_t def_match_idx = -1;
-			for (i = 0; i < rrset->rr_count; ++i) {
-				ret = check_view_info(q, &rrset->rrs[i]);
-				if (ret == VIEW_MATCH_NAME) {
-					view_match_idx = i;
-					break;
-				} else if (ret == VIEW_MATCH_DEF) {
-					def_match_idx = i;
-				}
-			}
-			int16_t rrs_idx = -1;
-			if (view_match_idx != -1) {
-				rrs_idx = view_match_idx;
-			} else if (def_match_idx != -1) {
-				rrs_idx = def_match_idx;
-			} else {
+			uint16_t match_num;
+			rr_type *rrs = rrset_view_rrs(q, rrset, 1, &match_num);
+			if (match_num == 0) {
 				return;
 			}
-			domain_type *closest_match = rdata_atom_domain(rrset->rrs[rrs_idx].rdatas[0]);
+			domain_type *closest_match = rdata_atom_domain(rrs[0].rdatas[0]);
 			domain_type *closest_encloser = closest_match;
 			zone_type* origzone = q->zone;
 			++q->cname_count;
@@ -341,8 +362,9 @@ answer_authoritative(struct kdns   * kdns,
 		match->parent = closest_encloser;
 		match->wildcard_child_closest_match = match;
 		match->rrsets = wildcard_child->rrsets;
-		match->compressed_offset = DNS_HEAD_SIZE;
 		match->is_existing = wildcard_child->is_existing;
+		/* the expanded name is the qname */
+		query_compress_add(q, match, DNS_HEAD_SIZE);
 
 		/*
 		 * Remember the original domain in case a Wildcard No
@@ -401,23 +423,11 @@ answer_lookup_zone(struct kdns * kdns, struct query *q, kdns_answer_st *answer,
 	
 }
 
-static void query_compressed_table_clear(struct query *q){
-    int i =0;
-    for(;i < q->compressed_count; i++){
-        if (q->compressed_dnames[i] != NULL) {
-            q->compressed_dnames[i]->compressed_offset = 0;
-        }      
-    }
-    q->compressed_count = 0;    
-}
-
 static void
 query_compressed_table_add(struct query *q, domain_type *domain, uint16_t offset)
 {
 	while (domain->parent) {
-		domain->compressed_offset = offset;
-		q->compressed_dnames[q->compressed_count] = domain;
-		q->compressed_count++;
+		query_compress_add(q, domain, offset);
 
 		offset += label_length(domain_name_get(domain_dname(domain))) + 1;
 		domain = domain->parent;
@@ -438,7 +448,6 @@ query_response(struct kdns * kdns, struct query *q)
 		offset = domain_name_label_offsets(q->qname)[domain_dname(closest_encloser)->label_count - 1] + DNS_HEAD_SIZE;
 		query_compressed_table_add(q, closest_encloser, offset);
 		encode_answer(q, &q->answer);
-		query_compressed_table_clear(q);
 	}
 }
 
@@ -475,6 +484,9 @@ query_state_type query_process(kdns_query_st *q, kdns_type * kdns)
 	if (GET_RCODE(q->packet) != RCODE_OK || !process_query_section(q)) {
 		return query_format_error(q);
 	}
+	size_t question_end = buffer_get_position(q->packet);
+	process_edns_section(q);
+	buffer_set_position(q->packet, question_end);
     // question count must be 1
 	if (GET_QD_COUNT(q->packet) != 1) {
 		SET_FLAGS(q->packet, 0);
@@ -31,6 +31,19 @@ typedef struct answer {
     rr_section_type section[MAXRRSPP];
 }kdns_answer_st;
 
+/*
+ * Name compression offsets of the response being encoded, keyed by the
+ * domain node so the zone data is never written.  Slots of an older gen
+ * are empty, a slot with a NULL domain was rolled back.
+ */
+#define COMPRESS_TABLE_BITS 11
+
+typedef struct compress_slot {
+    const domain_type *domain;
+    uint16_t offset;
+    uint16_t gen;
+} compress_slot_st;
+
 /* Query as we pass it around */
 
 typedef struct query {
@@ -42,7 +55,9 @@ typedef struct query {
     uint8_t opcode;
 
     uint32_t sip;
-    char view_name[MAX_VIEW_NAME_LEN];
+    uint32_t ecs_key;   /* hash of the EDNS client subnet */
+    uint8_t has_ecs;
+    uint16_t view_id;
     
 	zone_type *zone;
     
@@ -51,8 +66,10 @@ typedef struct query {
     uint32_t maxAnswer;
     uint32_t maxMsgLen;
 
-    domain_type *compressed_dnames[MAXRRSPP];
-    uint16_t    compressed_count;
+    compress_slot_st compress_table[1 << COMPRESS_TABLE_BITS];
+    uint16_t    compress_log[MAXRRSPP];     /* slots in the order added */
+    uint16_t    compress_count;
+    uint16_t    compress_gen;
 
     kdns_answer_st answer;
     /*
@@ -63,16 +80,93 @@ typedef struct query {
 	*/
 }kdns_query_st;
 
-static inline int check_view_info(kdns_query_st *query, rr_type *rr)
+/*
+ * The rrs answered to the query, a slice of the rrset: its own view, else
+ * the default view.  Only the rrs that are up unless with_down.
+ */
+static inline rrset_view_type *rrset_view_slice(kdns_query_st *query, rrset_type *rrset, int with_down)
+{
+    rrset_view_type *view = rrset_find_view(rrset, query->view_id);
+
+    if (view == NULL || (with_down ? view->count : view->up) == 0) {
+        view = rrset_find_view(rrset, VIEW_ID_DEFAULT);
+    }
+    if (view == NULL || (with_down ? view->count : view->up) == 0) {
+        return NULL;
+    }
+    return view;
+}
+
+static inline rr_type *rrset_view_rrs(kdns_query_st *query, rrset_type *rrset, int with_down, uint16_t *num)
+{
+    rrset_view_type *view = rrset_view_slice(query, rrset, with_down);
+
+    if (view == NULL) {
+        *num = 0;
+        return NULL;
+    }
+    *num = with_down ? view->count : view->up;
+    return &rrset->rrs[view->start];
+}
+
+static inline uint32_t query_compress_slot(const domain_type *domain)
 {
-    // rr no view info 
-    if (0 == strcmp(rr->view_name,DEFAULT_VIEW_NAME)){
-        return VIEW_MATCH_DEF;
+    return (uint32_t)((((uintptr_t)domain >> 4) * 0x9e3779b97f4a7c15ULL) >> (64 - COMPRESS_TABLE_BITS));
+}
+
+/* offset of the name in the response, 0 if it is not there yet */
+static inline uint16_t query_compress_find(kdns_query_st *q, const domain_type *domain)
+{
+    uint32_t mask = (1 << COMPRESS_TABLE_BITS) - 1;
+    uint32_t i = query_compress_slot(domain);
+
+    while (q->compress_table[i].gen == q->compress_gen) {
+        if (q->compress_table[i].domain == domain) {
+            return q->compress_table[i].offset;
+        }
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+/* a full table or an offset a pointer can not reach leaves the name uncompressed */
+static inline void query_compress_add(kdns_query_st *q, const domain_type *domain, uint16_t offset)
+{
+    uint32_t mask = (1 << COMPRESS_TABLE_BITS) - 1;
+    uint32_t i = query_compress_slot(domain);
+
+    if (q->compress_count >= MAXRRSPP || offset > 0x3fff) {
+        return;
     }
-    if (0 == strcmp(query->view_name,rr->view_name)){
-        return VIEW_MATCH_NAME;
+    while (q->compress_table[i].gen == q->compress_gen) {
+        i = (i + 1) & mask;
+    }
+    q->compress_table[i].domain = domain;
+    q->compress_table[i].offset = offset;
+    q->compress_table[i].gen = q->compress_gen;
+    q->compress_log[q->compress_count++] = i;
+}
+
+/* forget the names written at or after mark, the rr there was truncated */
+static inline void query_compress_rollback(kdns_query_st *q, size_t mark)
+{
+    while (q->compress_count > 0) {
+        compress_slot_st *slot = &q->compress_table[q->compress_log[q->compress_count - 1]];
+        if (slot->offset < mark) {
+            break;
+        }
+        slot->domain = NULL;
+        q->compress_count--;
+    }
+}
+
+static inline void query_compress_clear(kdns_query_st *q)
+{
+    q->compress_count = 0;
+    if (++q->compress_gen == 0) {
+        memset(q->compress_table, 0, sizeof(q->compress_table));
+        q->compress_gen = 1;
     }
-    return VIEW_MATCH_NONE;
 }
 
 void encode_answer(kdns_query_st *q, const kdns_answer_st *answer);
@@ -0,0 +1,106 @@
+/*
+ * slab.c -- fixed size objects carved from hugepage chunks.
+ *
+ * Copyright (c) 2018 The TIGLabs Authors.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include "slab.h"
+#include "util.h"
+
+struct slab_chunk {
+	struct slab_chunk *next;
+	int hugepage;
+};
+
+#define SLAB_CHUNK_HEAD ALIGN_UP(sizeof(struct slab_chunk), RTE_CACHE_LINE_SIZE)
+
+void
+slab_init(struct slab *slab, const char *name, size_t obj_size, uint32_t obj_num)
+{
+	if (obj_size < sizeof(void *))
+		obj_size = sizeof(void *);
+	slab->name = name;
+	slab->obj_size = ALIGN_UP(obj_size, sizeof(void *));
+	slab->obj_num = obj_num;
+	slab->socket_id = rte_socket_id();
+	slab->free_list = NULL;
+	slab->chunks = NULL;
+	slab->in_use = 0;
+}
+
+static void
+slab_grow(struct slab *slab)
+{
+	size_t size = SLAB_CHUNK_HEAD + slab->obj_size * slab->obj_num;
+	struct slab_chunk *chunk;
+	uint8_t *obj;
+	uint32_t i;
+
+	chunk = rte_malloc_socket(slab->name, size, RTE_CACHE_LINE_SIZE, slab->socket_id);
+	if (chunk) {
+		chunk->hugepage = 1;
+	} else {
+		static int heap_logged;
+		if (!heap_logged) {
+			heap_logged = 1;
+			log_msg(LOG_ERR, "hugepage heap exhausted, slab %s falls back to malloc\n", slab->name);
+		}
+		chunk = xalloc(size);
+		chunk->hugepage = 0;
+	}
+	chunk->next = slab->chunks;
+	slab->chunks = chunk;
+
+	/* push in reverse so the objects are handed out in address order */
+	obj = (uint8_t *)chunk + SLAB_CHUNK_HEAD;
+	for (i = slab->obj_num; i > 0; --i) {
+		void **o = (void **)(obj + (i - 1) * slab->obj_size);
+		*o = slab->free_list;
+		slab->free_list = o;
+	}
+}
+
+void *
+slab_alloc(struct slab *slab)
+{
+	void **obj;
+
+	if (slab->free_list == NULL)
+		slab_grow(slab);
+	obj = slab->free_list;
+	slab->free_list = *obj;
+	slab->in_use++;
+	memset(obj, 0, slab->obj_size);
+	return obj;
+}
+
+void
+slab_free(struct slab *slab, void *obj)
+{
+	if (obj == NULL)
+		return;
+	*(void **)obj = slab->free_list;
+	slab->free_list = obj;
+	slab->in_use--;
+}
+
+void
+slab_release(struct slab *slab)
+{
+	struct slab_chunk *chunk;
+
+	while ((chunk = slab->chunks) != NULL) {
+		slab->chunks = chunk->next;
+		if (chunk->hugepage)
+			rte_free(chunk);
+		else
+			free(chunk);
+	}
+	slab->free_list = NULL;
+	slab->in_use = 0;
+}
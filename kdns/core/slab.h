@@ -0,0 +1,39 @@
+/*
+ * slab.h -- fixed size objects carved from hugepage chunks.
+ *
+ * Copyright (c) 2018 The TIGLabs Authors.
+ *
+ */
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A slab is owned by one lcore, it is not thread safe.  The chunks come
+ * from the hugepage heap of the socket of the lcore that initialized
+ * it, or from malloc when that heap is exhausted.  Freed objects are
+ * reused, the chunks are only returned by slab_release.
+ */
+struct slab {
+	const char *name;
+	size_t obj_size;
+	uint32_t obj_num;       /* objects per chunk */
+	int socket_id;
+	void *free_list;
+	struct slab_chunk *chunks;
+	uint32_t in_use;
+};
+
+void slab_init(struct slab *slab, const char *name, size_t obj_size, uint32_t obj_num);
+
+/* zeroed object, exits when out of memory like xalloc */
+void *slab_alloc(struct slab *slab);
+
+void slab_free(struct slab *slab, void *obj);
+
+void slab_release(struct slab *slab);
+
+#endif /* _SLAB_H_ */
@@ -5,8 +5,12 @@
  */
 
 #include <jansson.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <rte_byteorder.h>
+#include <rte_lcore.h>
+#include <rte_lpm.h>
 #include "view.h"
 #include "kdns.h"
 
@@ -14,6 +18,43 @@
 #define FIND_FIRST  0x2 
 #define FIND_BEST   0x4  
 
+int view_lpm_enable = 1;
+
+/* only the master writes them, a failed update leaves every lcore on its own trie */
+static struct rte_lpm *view_lpms[RTE_MAX_NUMA_NODES];
+static volatile int view_lpm_broken;
+
+static char view_names[VIEW_ID_MAX][MAX_VIEW_NAME_LEN] = {DEFAULT_VIEW_NAME};
+static uint16_t view_name_num = 1;
+static pthread_mutex_t view_name_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* only called on updates, the queries compare the ids */
+uint16_t view_id_intern(const char *view_name)
+{
+    uint16_t i, id = VIEW_ID_NONE;
+
+    if (view_name[0] == '\0') {
+        return VIEW_ID_DEFAULT;
+    }
+    pthread_mutex_lock(&view_name_lock);
+    for (i = 0; i < view_name_num; i++) {
+        if (strncmp(view_names[i], view_name, MAX_VIEW_NAME_LEN) == 0) {
+            id = i;
+            break;
+        }
+    }
+    if (id == VIEW_ID_NONE) {
+        if (view_name_num < VIEW_ID_MAX) {
+            id = view_name_num++;
+            snprintf(view_names[id], MAX_VIEW_NAME_LEN, "%s", view_name);
+        } else {
+            log_msg(LOG_ERR, "too many view names, %s is not interned\n", view_name);
+        }
+    }
+    pthread_mutex_unlock(&view_name_lock);
+    return id;
+}
+
 static view_node_t *view_tree_alloc_node(view_tree_t *tree)
 {
     view_node_t *node;
@@ -100,6 +141,7 @@ static int do_view_tree_insert(view_tree_t *tree, uint8_t *key, size_t nbits, ch
 
     memcpy(view_data->cidrs, pcidr, strlen(pcidr));
     memcpy(view_data->view_name, view_name, strlen(view_name));
+    view_data->view_id = view_id_intern(view_name);
     /* set view_name */
     node->view_data = view_data;
     tree->size++;
@@ -113,6 +155,75 @@ view_value_t* view_find(view_tree_t *tree, uint8_t *key, size_t nbits)
     return node ? node->view_data : VIEW_NO_NODE;
 }
 
+uint16_t view_lookup(view_tree_t *tree, uint32_t addr)
+{
+    uint32_t next_hop;
+    struct rte_lpm *lpm = tree->socket >= 0 ? view_lpms[tree->socket] : NULL;
+
+    if (lpm && !view_lpm_broken) {
+        if (rte_lpm_lookup(lpm, rte_be_to_cpu_32(addr), &next_hop) == 0) {
+            return (uint16_t)next_hop;
+        }
+        return VIEW_ID_NONE;
+    }
+
+    view_value_t *data = view_find(tree, (uint8_t *)&addr, 32);
+    return data != VIEW_NO_NODE ? data->view_id : VIEW_ID_NONE;
+}
+
+void view_lpm_master_init(view_tree_t *tree)
+{
+    char name[RTE_LPM_NAMESIZE];
+    unsigned lcore_id, socket;
+    struct rte_lpm_config config = {
+        .max_rules = VIEW_LPM_MAX_RULES,
+        .number_tbl8s = VIEW_LPM_TBL8_NUM,
+        .flags = 0,
+    };
+
+    if (!view_lpm_enable) {
+        return;
+    }
+    RTE_LCORE_FOREACH(lcore_id) {
+        socket = rte_lcore_to_socket_id(lcore_id);
+        if (view_lpms[socket] != NULL) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "view_lpm_%u", socket);
+        view_lpms[socket] = rte_lpm_create(name, socket, &config);
+        if (view_lpms[socket] == NULL) {
+            log_msg(LOG_ERR, "failed to create view lpm %s, the lcores of socket %u lookup their view tree\n", name, socket);
+        }
+    }
+    tree->lpm_writer = 1;
+}
+
+/*
+ * The tries stay the reference, the lpms are left to them once one can
+ * not follow.  The lcores lookup while master updates, a query racing
+ * the change may still get the old view.
+ */
+static void view_lpm_update(struct in_addr *ip, size_t nbits, uint16_t view_id, enum view_action action)
+{
+    unsigned socket;
+    int ret;
+
+    for (socket = 0; socket < RTE_MAX_NUMA_NODES && !view_lpm_broken; ++socket) {
+        if (view_lpms[socket] == NULL) {
+            continue;
+        }
+        if (action == ACTION_ADD) {
+            ret = rte_lpm_add(view_lpms[socket], rte_be_to_cpu_32(ip->s_addr), nbits, view_id);
+        } else {
+            ret = rte_lpm_delete(view_lpms[socket], rte_be_to_cpu_32(ip->s_addr), nbits);
+        }
+        if (ret != 0) {
+            log_msg(LOG_ERR, "failed to update view lpm of socket %u: %d, lookup the view tree instead\n", socket, ret);
+            view_lpm_broken = 1;
+        }
+    }
+}
+
 static int do_view_tree_delete(view_tree_t *tree, uint8_t *key, size_t nbits, char *pcidr, char *view_name)
 {
     view_node_t *node = do_view_tree_get(tree, key, nbits, 0);
@@ -157,6 +268,8 @@ view_tree_t *view_tree_create(void)
 
     tree->free = NULL;
     tree->size = 0;
+    tree->socket = (rte_lcore_id() != LCORE_ID_ANY) ? (int)rte_socket_id() : -1;
+    tree->lpm_writer = 0;
     tree->root = view_tree_alloc_node(tree);
 
     return tree;
@@ -201,6 +314,12 @@ int view_operate(view_tree_t *tree, char *pcidr, char *view_name, enum view_acti
             log_msg(LOG_ERR, "failed to delete view_name %s, cidr %s from view tree!\n", view_name, cidr);
         }
     }
+    if (ret == 0 && tree->lpm_writer) {
+        /* a duplicate insert keeps the view already in the trie */
+        view_node_t *node = do_view_tree_get(tree, (uint8_t *)&ip.s_addr, nbits, 0);
+        uint16_t view_id = (node && node->view_data) ? node->view_data->view_id : VIEW_ID_NONE;
+        view_lpm_update(&ip, nbits, view_id, action);
+    }
 
 _out:
     free(cidr);
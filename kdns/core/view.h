@@ -15,6 +15,12 @@
 #define VIEW_NULL_VALUE NULL
 #define VIEW_NO_NODE    NULL
 
+#define VIEW_LPM_MAX_RULES  65536
+#define VIEW_LPM_TBL8_NUM   1024
+
+/* one lpm per socket, 64MB tbl24 + 1MB tbl8 each. 0: classify with the trie of each lcore */
+extern int view_lpm_enable;
+
 /* type of stored value */
 enum view_action {
 	ACTION_ADD,
@@ -24,6 +30,7 @@ enum view_action {
 typedef struct view_value{
     char  cidrs[MAX_VIEW_NAME_LEN];
     char  view_name[MAX_VIEW_NAME_LEN];
+    uint16_t view_id;
 }view_value_t;
 
 typedef struct _view_node {
@@ -33,15 +40,25 @@ typedef struct _view_node {
     view_value_t * view_data;
 } view_node_t;
 
+/* the trie holds the views, the lpm of the socket built from the master trie classifies the queries */
 typedef struct view_tree {
     view_node_t *root;
     view_node_t *free; 
     int size;
+    int socket;         /* socket of the lpm to lookup, -1 for a thread that is not an lcore */
+    int lpm_writer;     /* the master tree, its changes go to the lpm of every socket */
 } view_tree_t;
 
+/* id of the view name, shared by all lcores, ids are never released */
+uint16_t view_id_intern(const char *view_name);
+
 int view_operate(view_tree_t *tree, char *pcidr, char *view_name, enum view_action action);
 view_tree_t *view_tree_create(void);
+/* on master, create the lpm of every socket with lcores and let the tree write them */
+void view_lpm_master_init(view_tree_t *tree);
 view_value_t* view_find(view_tree_t *tree, uint8_t *key, size_t nbits);
+/* view id of the ipv4 addr in network order, VIEW_ID_NONE if no view matches */
+uint16_t view_lookup(view_tree_t *tree, uint32_t addr);
 void view_tree_dump(view_node_t *node,  void* arg1,void (*callback)(void*,view_value_t *));
 
 #endif
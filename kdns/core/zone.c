@@ -223,6 +223,8 @@ domain_store_zone_delete(domain_store_type* db, zone_type* zone)
 
 	/* soa_rrset is freed when the SOA was deleted */
 	if(zone->soa_nx_rrset) {
+		free(zone->soa_nx_rrset->views);
+		free(zone->soa_nx_rrset->lb_sched);
 		free(zone->soa_nx_rrset->rrs);
 		free(zone->soa_nx_rrset);
 	}
@@ -27,6 +27,21 @@ static unsigned master_lcore;
 static struct rte_ring *ctrl_msg_ring[MAX_CORES];
 static struct ctrl_msg_manage ctrl_msg_mt;
 
+void *ctrl_msg_alloc(ctrl_msg_type type, uint32_t len) {
+    ctrl_msg *msg = xalloc_zero(len);
+
+    msg->type = type;
+    msg->len = len;
+    rte_atomic32_set(&msg->refcnt, 1);
+    return msg;
+}
+
+void ctrl_msg_free(ctrl_msg *msg) {
+    if (rte_atomic32_dec_and_test(&msg->refcnt)) {
+        free(msg);
+    }
+}
+
 static int ctrl_msg_ingress(struct rte_ring *ring, void **msg, uint16_t msg_cnt) {
     uint16_t nb_tx;
 
@@ -35,7 +50,7 @@ static int ctrl_msg_ingress(struct rte_ring *ring, void **msg, uint16_t msg_cnt)
         uint16_t s_cnt = nb_tx;
         log_msg(LOG_ERR, "%s packet loss due to full ring, loss %d\n", ring->name, msg_cnt - nb_tx);
         do {
-            free(msg[nb_tx]);
+            ctrl_msg_free(msg[nb_tx]);
         } while (++nb_tx < msg_cnt);
         return s_cnt;
     }
@@ -46,6 +61,39 @@ int ctrl_msg_master_ingress(void **msg, uint16_t msg_cnt) {
     return ctrl_msg_ingress(ctrl_msg_ring[master_lcore], msg, msg_cnt);
 }
 
+/* rx lcores only distribute packets and keep no domain store */
+static inline int ctrl_msg_slave_synced(unsigned lcore_id) {
+    return netif_queue_conf_get(lcore_id)->role != NETIF_ROLE_RX;
+}
+
+static int ctrl_msg_slaves_room(void) {
+    unsigned lcore_id;
+
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        if (ctrl_msg_slave_synced(lcore_id) && rte_ring_free_count(ctrl_msg_ring[lcore_id]) < NETIF_MAX_PKT_BURST) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int ctrl_msg_master_ingress_wait(void **msg, uint16_t msg_cnt) {
+    uint16_t nb_tx = 0;
+
+    while (1) {
+        nb_tx += rte_ring_enqueue_burst(ctrl_msg_ring[master_lcore], msg + nb_tx, msg_cnt - nb_tx);
+        if (nb_tx == msg_cnt) {
+            return nb_tx;
+        }
+        //a burst is only forwarded when every slave ring can take it, so nothing is dropped on the way
+        if (ctrl_msg_slaves_room()) {
+            ctrl_msg_master_process();
+        } else {
+            rte_delay_us(10);
+        }
+    }
+}
+
 int ctrl_msg_slave_ingress(void **msg, uint16_t msg_cnt, unsigned slave_lcore) {
     return ctrl_msg_ingress(ctrl_msg_ring[slave_lcore], msg, msg_cnt);
 }
@@ -62,61 +110,63 @@ uint16_t ctrl_msg_slave_process(unsigned slave_lcore) {
     for (i = 0; i < nb_rx; ++i) {
         if (msg[i]->type < 0 || msg[i]->type >= CTRL_MSG_TYPE_MAX) {
             log_msg(LOG_ERR, "unknow msg type %d on slave_lcore %u\n", msg[i]->type, slave_lcore);
-            free(msg[i]);
+            ctrl_msg_free(msg[i]);
             continue;
         }
         if (ctrl_msg_mt.slave_cb[msg[i]->type]) {
             ctrl_msg_mt.slave_cb[msg[i]->type](msg[i], slave_lcore);
         } else {
             log_msg(LOG_ERR, "unexpected msg %d on slave_lcore %u\n", msg[i]->type, slave_lcore);
-            free(msg[i]);
+            ctrl_msg_free(msg[i]);
         }
     }
     return nb_rx;
 }
 
 uint16_t ctrl_msg_master_process(void) {
-    uint16_t i, nb_copy, nb_rx;
+    uint16_t i, nb_sync, nb_rx;
+    unsigned lcore_id, nb_synced = 0;
     ctrl_msg *msg[NETIF_MAX_PKT_BURST];
-    ctrl_msg *msg_copy[NETIF_MAX_PKT_BURST];
+    ctrl_msg *msg_sync[NETIF_MAX_PKT_BURST];
 
     nb_rx = rte_ring_dequeue_burst(ctrl_msg_ring[master_lcore], (void **)msg, NETIF_MAX_PKT_BURST);
     if (likely(nb_rx == 0)) {
         return 0;
     }
 
-    unsigned lcore_id;
+    /* the msgs are shared by pointer, each slave drops its own ref when done */
     RTE_LCORE_FOREACH_SLAVE(lcore_id) {
-        nb_copy = 0;
-        for (i = 0; i < nb_rx; ++i) {
-            if (msg[i]->type < 0 || msg[i]->type >= CTRL_MSG_TYPE_MAX) {
-                log_msg(LOG_ERR, "unknow msg type %d on master_lcore\n", msg[i]->type);
-                continue;
-            }
-            if (ctrl_msg_mt.ctrl_flag[msg[i]->type] & CTRL_MSG_FLAG_MASTER_SYNC_SLAVE) {
-                msg_copy[nb_copy] = xalloc_zero(msg[i]->len);
-                memcpy(msg_copy[nb_copy], msg[i], msg[i]->len);
-                ++nb_copy;
-            }
+        nb_synced += ctrl_msg_slave_synced(lcore_id);
+    }
+    nb_sync = 0;
+    for (i = 0; i < nb_rx; ++i) {
+        if (msg[i]->type < 0 || msg[i]->type >= CTRL_MSG_TYPE_MAX) {
+            continue;
         }
-        if (nb_copy) {
-            ctrl_msg_ingress(ctrl_msg_ring[lcore_id], (void **)msg_copy, nb_copy);
-        } else {
-            break;
+        if (ctrl_msg_mt.ctrl_flag[msg[i]->type] & CTRL_MSG_FLAG_MASTER_SYNC_SLAVE) {
+            rte_atomic32_add(&msg[i]->refcnt, nb_synced);
+            msg_sync[nb_sync++] = msg[i];
+        }
+    }
+    if (nb_sync) {
+        RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+            if (ctrl_msg_slave_synced(lcore_id)) {
+                ctrl_msg_ingress(ctrl_msg_ring[lcore_id], (void **)msg_sync, nb_sync);
+            }
         }
     }
 
     for (i = 0; i < nb_rx; ++i) {
         if (msg[i]->type < 0 || msg[i]->type >= CTRL_MSG_TYPE_MAX) {
             log_msg(LOG_ERR, "unknow msg type %d on master_lcore\n", msg[i]->type);
-            free(msg[i]);
+            ctrl_msg_free(msg[i]);
             continue;
         }
         if (ctrl_msg_mt.master_cb[msg[i]->type]) {
             ctrl_msg_mt.master_cb[msg[i]->type](msg[i]);
         } else {
             log_msg(LOG_ERR, "unexpected msg %d on master_lcore\n", msg[i]->type);
-            free(msg[i]);
+            ctrl_msg_free(msg[i]);
         }
     }
     return nb_rx;
@@ -139,11 +189,12 @@ void ctrl_msg_init(void) {
 
     master_lcore = rte_get_master_lcore();
     RTE_LCORE_FOREACH(lcore_id) {
+        /* placed on the socket of the consumer */
         snprintf(ring_name, sizeof(ring_name), "ctrl_msg_ring_%u", lcore_id);
         if (lcore_id == master_lcore) {
-            ctrl_msg_ring[lcore_id] = rte_ring_create(ring_name, CTRL_RING_SZ, rte_socket_id(), RING_F_SC_DEQ);
+            ctrl_msg_ring[lcore_id] = rte_ring_create(ring_name, CTRL_RING_SZ, rte_lcore_to_socket_id(lcore_id), RING_F_SC_DEQ);
         } else {
-            ctrl_msg_ring[lcore_id] = rte_ring_create(ring_name, CTRL_RING_SZ, rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ);
+            ctrl_msg_ring[lcore_id] = rte_ring_create(ring_name, CTRL_RING_SZ, rte_lcore_to_socket_id(lcore_id), RING_F_SP_ENQ | RING_F_SC_DEQ);
         }
         if (ctrl_msg_ring[lcore_id] == NULL) {
             log_msg(LOG_ERR, "Cannot create %s\n", ring_name);
@@ -2,8 +2,15 @@
  * data_update.c
  */
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <arpa/inet.h>
 #include "db_update.h"
 #include "util.h"
+#include "view.h"
+#include "snapshot.h"
+
+#define ZONE_REPLACE_INIT_SIZE  (1 << 12)
 
 static rrset_type *do_domaindata_insert(struct domain_store *db, zone_type *zo, const domain_name_st *dname, rr_type *rr, uint32_t maxAnswer)
 {
@@ -17,29 +24,54 @@ static rrset_type *do_domaindata_insert(struct domain_store *db, zone_type *zo,
     /* Do we have this type of rrset already? */
     rrset = domain_find_rrset(rr->owner, zo, rr->type);
     if (!rrset) {
-        rrset           = (rrset_type *)xalloc_zero(sizeof(rrset_type));
+        rrset           = (rrset_type *)slab_alloc(&db->domains->rrset_slab);
         rrset->zone     = zo;
+        rrset_rrs_reserve(rrset, 1);
         rrset->rr_count = 1;
-        rrset->rrs      = (rr_type *)xalloc_zero(sizeof(rr_type));
         rrset->rrs[0]   = *rr;
 
         /* Add it */
         domain_add_rrset(rr->owner, rrset);
+    } else if (db->batch) {
+        rr_type *same_view = rrset_batch_find_view(db, rrset, rr->view_id);
+        if (same_view) {
+            if (same_view->ttl != rr->ttl || same_view->lb_mode != rr->lb_mode) {
+                log_msg(LOG_ERR, "ttl or lb_mode not match in same view\n");
+                return NULL;
+            }
+            if (rrset_batch_find_rr(db, rrset, rr)) {
+                return NULL;
+            }
+            if (rr->type == TYPE_CNAME) {
+                log_msg(LOG_ERR, "multiple CNAMEs at the same name in same view\n");
+                return NULL;
+            }
+        }
+        if (rrset->rr_count == 65535) {
+            log_msg(LOG_ERR, "too many RRs for domain RRset\n");
+            return NULL;
+        }
+
+        rrset_rrs_reserve(rrset, rrset->rr_count + 1);
+        rrset->rrs[rrset->rr_count] = *rr;
+        rrset_batch_add_rr(db, rrset, rrset->rr_count);
+        ++rrset->rr_count;
     } else {
         int i;
-        rr_type *o;
         /* Search for possible duplicates... */
         for (i = 0; i < rrset->rr_count; i++) {
-            if (!strcmp(rrset->rrs[i].view_name, rr->view_name) 
-                    && (rrset->rrs[i].ttl != rr->ttl || rrset->rrs[i].lb_mode != rr->lb_mode)) {
+            if (rrset->rrs[i].view_id != rr->view_id) {
+                continue;
+            }
+            if (rrset->rrs[i].ttl != rr->ttl || rrset->rrs[i].lb_mode != rr->lb_mode) {
                 log_msg(LOG_ERR, "ttl or lb_mode not match in same view\n");
                 return NULL;
             }
             /* Discard the duplicates... */
-            if (!zrdatacmp(rr->type, rr, &rrset->rrs[i]) && !strcmp(rrset->rrs[i].view_name, rr->view_name)) {
+            if (!zrdatacmp(rr->type, rr, &rrset->rrs[i])) {
                 return NULL;
             }
-            if (rr->type == TYPE_CNAME && !strcmp(rrset->rrs[i].view_name, rr->view_name)) {
+            if (rr->type == TYPE_CNAME) {
                 log_msg(LOG_ERR, "multiple CNAMEs at the same name in same view\n");
                 return NULL;
             }
@@ -50,13 +82,11 @@ static rrset_type *do_domaindata_insert(struct domain_store *db, zone_type *zo,
         }
 
         /* Add it... */
-        o = rrset->rrs;
-        rrset->rrs = (rr_type *)xalloc_array_zero(rrset->rr_count + 1, sizeof(rr_type));
-        memcpy(rrset->rrs, o, (rrset->rr_count) * sizeof(rr_type));
-        free(o);
+        rrset_rrs_reserve(rrset, rrset->rr_count + 1);
         rrset->rrs[rrset->rr_count] = *rr;
         ++rrset->rr_count;
     }
+    rrset_index_update(db, rrset);
     return rrset;
 }
 
@@ -78,7 +108,7 @@ static int do_domaindata_delete(struct domain_store *db, zone_type *zo, const do
         int rrnum;
         /* Search for the val ... */
         for (rrnum = 0; rrnum < rrset->rr_count; rrnum++) {
-            if (!zrdatacmp(rr->type, rr, &rrset->rrs[rrnum]) && !strcmp(rrset->rrs[rrnum].view_name, rr->view_name)) {
+            if (rrset->rrs[rrnum].view_id == rr->view_id && !zrdatacmp(rr->type, rr, &rrset->rrs[rrnum])) {
                 break;
             }
         }
@@ -91,22 +121,16 @@ static int do_domaindata_delete(struct domain_store *db, zone_type *zo, const do
                 rrset_zero_nonexist_check(domain, NULL);
                 domain_table_deldomain(db, domain);
             } else {
-                rr_type *rrs_orig = rrset->rrs;
+                /* swap remove, the index build sorts the rrs again */
+                domain_store_batch_forget(db);
                 add_rdata_to_recyclebin(&rrset->rrs[rrnum]);
                 if (rrnum < rrset->rr_count - 1) {
                     rrset->rrs[rrnum] = rrset->rrs[rrset->rr_count - 1];
                 }
                 memset(&rrset->rrs[rrset->rr_count - 1], 0, sizeof(rr_type));
-
-                /* realloc the rrs array one smaller */
-                rrset->rrs = xalloc_array_zero(rrset->rr_count - 1, sizeof(rr_type));
-                if (!rrset->rrs) {
-                    log_msg(LOG_ERR, "out of memory, %s:%d\n", __FILE__, __LINE__);
-                    exit(1);
-                }
-                memcpy(rrset->rrs, rrs_orig, (rrset->rr_count - 1) * sizeof(rr_type));
-                free(rrs_orig);
                 rrset->rr_count--;
+                rrset_rrs_shrink(rrset);
+                rrset_index_update(db, rrset);
             }
         }
     }
@@ -132,7 +156,7 @@ static void db_zadd_rdata_wireformat(rr_type *rr, uint16_t *data)
     }
 }
 
-int domaindata_soa_insert(struct domain_store *db, char *zone_name)
+int domaindata_soa_insert(struct domain_store *db, char *zone_name, struct zone_soa_info *soa)
 {
     const domain_name_st *zname = domain_name_parse((const char *)zone_name);
     if (zname == NULL) {
@@ -146,14 +170,32 @@ int domaindata_soa_insert(struct domain_store *db, char *zone_name)
         return -1;
     }
 
-    char string[64] = {0};
-    snprintf(string, sizeof(string), "ns1.%s", zone_name);
+    char string[DB_MAX_NAME_LEN + 8] = {0};
+    if (soa) {
+        snprintf(string, sizeof(string), "%s", soa->primary_ns);
+    } else {
+        snprintf(string, sizeof(string), "ns1.%s", zone_name);
+    }
     const domain_name_st *ns1_name = domain_name_parse((const char *)string);
+    if (ns1_name == NULL) {
+        log_msg(LOG_ERR, "illegal soa name: %s\n", string);
+        free((void *)zname);
+        return -1;
+    }
     domain_type          *ns1_own  = domain_table_insert(db->domains, ns1_name, 0);
     free((void *)ns1_name);
 
-    snprintf(string, sizeof(string), "mail.%s", zone_name);
+    if (soa) {
+        snprintf(string, sizeof(string), "%s", soa->mailbox);
+    } else {
+        snprintf(string, sizeof(string), "mail.%s", zone_name);
+    }
     const domain_name_st *mail_name = domain_name_parse((const char *)string);
+    if (mail_name == NULL) {
+        log_msg(LOG_ERR, "illegal soa mailbox: %s\n", string);
+        free((void *)zname);
+        return -1;
+    }
     domain_type          *mail_own  = domain_table_insert(db->domains, mail_name, 0);
     free((void *)mail_name);
 
@@ -166,11 +208,25 @@ int domaindata_soa_insert(struct domain_store *db, char *zone_name)
     rr.rdatas = xalloc_array_zero(MAXRDATALEN, sizeof(rdata_atom_type));
     db_zadd_rdata_domain(&rr, ns1_own);                                //ns
     db_zadd_rdata_domain(&rr, mail_own);                               //mail
-    db_zadd_rdata_wireformat(&rr, zparser_conv_serial("2017070809"));  //serial number
-    db_zadd_rdata_wireformat(&rr, zparser_conv_serial("3600"));        //refresh
-    db_zadd_rdata_wireformat(&rr, zparser_conv_serial("900"));         //retry
-    db_zadd_rdata_wireformat(&rr, zparser_conv_serial("1209600"));     //expire
-    db_zadd_rdata_wireformat(&rr, zparser_conv_serial("1800"));        //  ttl
+    if (soa) {
+        char num[16];
+        snprintf(num, sizeof(num), "%u", soa->serial);
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial(num));
+        snprintf(num, sizeof(num), "%u", soa->refresh);
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial(num));
+        snprintf(num, sizeof(num), "%u", soa->retry);
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial(num));
+        snprintf(num, sizeof(num), "%u", soa->expire);
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial(num));
+        snprintf(num, sizeof(num), "%u", soa->minimum);
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial(num));
+    } else {
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial("2017070809"));  //serial number
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial("3600"));        //refresh
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial("900"));         //retry
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial("1209600"));     //expire
+        db_zadd_rdata_wireformat(&rr, zparser_conv_serial("1800"));        //  ttl
+    }
 
     rrset_type *rrset = do_domaindata_insert(db, zo, zname, &rr, 0);
     if (rrset == NULL) {
@@ -246,8 +302,8 @@ int domaindata_update(struct domain_store *db, struct domin_info_update *update)
     rr.ttl           = update->ttl;
     rr.lb_mode       = update->lb_mode;
     rr.lb_weight     = update->lb_weight;
-    rr.lb_weight_cur = update->lb_weight;
     snprintf(rr.view_name, MAX_VIEW_NAME_LEN, "%s", update->view_name);
+    rr.view_id       = view_id_intern(rr.view_name);
 
     rr.rdatas = xalloc_array_zero(MAXRDATALEN, sizeof(rdata_atom_type));
     if (update->type == TYPE_A) {
@@ -287,3 +343,305 @@ int domaindata_update(struct domain_store *db, struct domin_info_update *update)
         return ret;
     }
 }
+
+static int domain_status_entry_cmp(const void *a, const void *b)
+{
+    const struct domain_status_entry *sa = a, *sb = b;
+    int ret = strcasecmp(sa->domain_name, sb->domain_name);
+
+    if (ret == 0) {
+        ret = strcmp(sa->view_name, sb->view_name);
+    }
+    return ret ? ret : (int)sa->type - (int)sb->type;
+}
+
+struct domain_status_update *domain_status_build(struct domain_status_entry *entries, uint32_t num)
+{
+    struct snapshot_buf buf;
+    struct domain_status_update *update;
+    uint32_t i, j, k, b;
+    uint16_t addr_num;
+    uint8_t bits;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.size = ZONE_REPLACE_INIT_SIZE;
+    buf.data = xalloc_zero(buf.size);
+    buf.len = sizeof(struct domain_status_update);
+
+    qsort(entries, num, sizeof(struct domain_status_entry), domain_status_entry_cmp);
+    for (i = 0; i < num; i = j) {
+        for (j = i + 1; j < num && j - i < UINT16_MAX && domain_status_entry_cmp(&entries[i], &entries[j]) == 0; j++) {
+        }
+        addr_num = j - i;
+        snapshot_buf_put_str(&buf, entries[i].domain_name, sizeof(entries[i].domain_name));
+        snapshot_buf_put_str(&buf, entries[i].view_name, sizeof(entries[i].view_name));
+        snapshot_buf_put(&buf, &entries[i].type, sizeof(entries[i].type));
+        snapshot_buf_put(&buf, &addr_num, sizeof(addr_num));
+        for (k = i; k < j; k++) {
+            snapshot_buf_put(&buf, entries[k].addr, entries[i].addr_len);
+        }
+        for (k = i; k < j; k += 8) {
+            bits = 0;
+            for (b = 0; b < 8 && k + b < j; b++) {
+                bits |= entries[k + b].enabled ? 1 << b : 0;
+            }
+            snapshot_buf_put(&buf, &bits, sizeof(bits));
+        }
+        buf.domain_num++;
+    }
+
+    update = xrealloc(buf.data, buf.len);
+    update->cmsg.type = CTRL_MSG_TYPE_DOMAIN_STATUS;
+    update->cmsg.len = buf.len;
+    rte_atomic32_set(&update->cmsg.refcnt, 1);
+    update->group_num = buf.domain_num;
+    update->status_num = num;
+    update->data_len = buf.len - sizeof(struct domain_status_update);
+    return update;
+}
+
+int domain_status_next(const struct domain_status_update *update, const char **cur, struct domain_status_group *group)
+{
+    const char *end = update->data + update->data_len;
+
+    if (*cur >= end) {
+        return 0;
+    }
+    if (snapshot_get_str(cur, end, group->domain_name, sizeof(group->domain_name)) < 0
+            || snapshot_get_str(cur, end, group->view_name, sizeof(group->view_name)) < 0
+            || snapshot_get(cur, end, &group->type, sizeof(group->type)) < 0
+            || snapshot_get(cur, end, &group->addr_num, sizeof(group->addr_num)) < 0
+            || (group->type != TYPE_A && group->type != TYPE_AAAA)) {
+        return -1;
+    }
+    group->addr_len = group->type == TYPE_A ? 4 : 16;
+    uint32_t len = group->addr_num * group->addr_len + (group->addr_num + 7) / 8;
+    if (len > (uint32_t)(end - *cur)) {
+        return -1;
+    }
+    group->addrs = (const uint8_t *)*cur;
+    group->enabled = group->addrs + group->addr_num * group->addr_len;
+    *cur += len;
+    return 1;
+}
+
+/* return the number of addresses of the group not found */
+static uint32_t do_domaindata_status(struct domain_store *db, const struct domain_status_group *group)
+{
+    uint16_t i, k, view_id;
+    uint32_t err_num = 0;
+    int changed = 0;
+
+    const domain_name_st *dname = domain_name_parse((const char *)group->domain_name);
+    if (dname == NULL) {
+        log_msg(LOG_ERR, "illegal domain name: %s\n", group->domain_name);
+        return group->addr_num;
+    }
+    domain_type *domain = domain_table_find(db->domains, dname);
+    free((void *)dname);
+    if (domain == NULL) {
+        log_msg(LOG_ERR, "domain not find: %s\n", group->domain_name);
+        return group->addr_num;
+    }
+    rrset_type *rrset = domain_find_rrset(domain, domain_find_zone(db, domain), group->type);
+    if (rrset == NULL) {
+        log_msg(LOG_ERR, "rrset not find: %s\n", group->domain_name);
+        return group->addr_num;
+    }
+    //the same id the queries pick their slice by, an empty name is the default view
+    view_id = view_id_intern(group->view_name);
+    if (view_id == VIEW_ID_NONE) {
+        return group->addr_num;
+    }
+
+    for (k = 0; k < group->addr_num; k++) {
+        const uint8_t *addr = group->addrs + k * group->addr_len;
+        uint8_t disabled = !(group->enabled[k / 8] & (1 << (k % 8)));
+        for (i = 0; i < rrset->rr_count; i++) {
+            rr_type *rr = &rrset->rrs[i];
+            if (rr->view_id == view_id && rr->rdata_count == 1 && rdata_atom_size(rr->rdatas[0]) == group->addr_len
+                    && !memcmp(rdata_atomdata(rr->rdatas[0]), addr, group->addr_len)) {
+                if (rr->disabled != disabled) {
+                    rr->disabled = disabled;
+                    changed = 1;
+                }
+                break;
+            }
+        }
+        if (i == rrset->rr_count) {
+            log_msg(LOG_ERR, "rr not find: %s\n", group->domain_name);
+            err_num++;
+        }
+    }
+    if (changed) {
+        rrset_index_update(db, rrset);
+    }
+    return err_num;
+}
+
+int domaindata_status_update(struct domain_store *db, struct domain_status_update *update)
+{
+    struct domain_status_group group;
+    const char *cur = update->data;
+    uint32_t err_num = 0;
+    int ret;
+
+    domain_store_batch_begin(db);
+    while ((ret = domain_status_next(update, &cur, &group)) > 0) {
+        err_num += do_domaindata_status(db, &group);
+    }
+    domain_store_batch_end(db);
+    return (ret < 0 || err_num) ? -1 : 0;
+}
+
+void zone_replace_init(struct snapshot_buf *buf)
+{
+    memset(buf, 0, sizeof(*buf));
+    buf->size = ZONE_REPLACE_INIT_SIZE;
+    buf->data = xalloc_zero(buf->size);
+    buf->len = sizeof(struct zone_replace_update);
+}
+
+void zone_replace_add(struct snapshot_buf *buf, struct domin_info_update *rec)
+{
+    snapshot_domain_encode(buf, rec);
+    buf->domain_num++;
+}
+
+struct zone_replace_update *zone_replace_finish(struct snapshot_buf *buf)
+{
+    struct zone_replace_update *update = xrealloc(buf->data, buf->len);
+
+    update->cmsg.type = CTRL_MSG_TYPE_REPLACE_ZONE;
+    update->cmsg.len = buf->len;
+    rte_atomic32_set(&update->cmsg.refcnt, 1);
+    update->update_num = buf->domain_num;
+    update->data_len = buf->len - sizeof(struct zone_replace_update);
+    buf->data = NULL;
+    return update;
+}
+
+int zone_replace_next(const struct zone_replace_update *update, const char **cur, struct domin_info_update *rec)
+{
+    const char *end = update->data + update->data_len;
+
+    if (*cur >= end) {
+        return 0;
+    }
+    rec->action = DOMAN_ACTION_ADD;
+    rec->hashValue = 0;
+    rec->next = NULL;
+    return snapshot_domain_decode(cur, end, rec) < 0 ? -1 : 1;
+}
+
+int domain_name_in_zone(const char *name, const char *zone_name)
+{
+    size_t len = strlen(name), zone_len = strlen(zone_name);
+
+    if (len == zone_len) {
+        return strcasecmp(name, zone_name) == 0;
+    }
+    return len > zone_len && name[len - zone_len - 1] == '.' && strcasecmp(name + len - zone_len, zone_name) == 0;
+}
+
+/* the checks of domaindata_update that do not depend on the store */
+static int zone_replace_record_check(const struct zone_replace_update *update, const struct domin_info_update *rec)
+{
+    const domain_name_st *name;
+    unsigned char addr[16];
+
+    if (strcasecmp(rec->zone_name, update->zone_name) != 0 || !domain_name_in_zone(rec->domain_name, update->zone_name)) {
+        log_msg(LOG_ERR, "domain %s is not in zone %s\n", rec->domain_name, update->zone_name);
+        return -1;
+    }
+    if ((name = domain_name_parse((const char *)rec->domain_name)) == NULL) {
+        log_msg(LOG_ERR, "illegal domain name: %s\n", rec->domain_name);
+        return -1;
+    }
+    free((void *)name);
+
+    switch (rec->type) {
+    case TYPE_A:
+    case TYPE_AAAA:
+        if (inet_pton(rec->type == TYPE_A ? AF_INET : AF_INET6, rec->host, addr) != 1) {
+            log_msg(LOG_ERR, "illegal address: %s\n", rec->host);
+            return -1;
+        }
+        return 0;
+    case TYPE_PTR:
+    case TYPE_CNAME:
+    case TYPE_SRV:
+        if ((name = domain_name_parse((const char *)rec->host)) == NULL) {
+            log_msg(LOG_ERR, "illegal host domain: %s\n", rec->host);
+            return -1;
+        }
+        free((void *)name);
+        return 0;
+    default:
+        log_msg(LOG_ERR, "err type: %u\n", rec->type);
+        return -1;
+    }
+}
+
+int zone_replace_check(const struct zone_replace_update *update)
+{
+    struct domin_info_update rec;
+    const char *cur = update->data;
+    uint32_t num = 0;
+    int ret;
+
+    while ((ret = zone_replace_next(update, &cur, &rec)) > 0) {
+        if (zone_replace_record_check(update, &rec) < 0) {
+            return -1;
+        }
+        ++num;
+    }
+    if (ret < 0 || num != update->update_num) {
+        log_msg(LOG_ERR, "replace zone %s: corrupted records\n", update->zone_name);
+        return -1;
+    }
+    return 0;
+}
+
+int domaindata_zone_replace(struct domain_store *db, struct zone_replace_update *update)
+{
+    uint32_t err_num = 0;
+    struct domin_info_update rec;
+    const char *cur = update->data;
+    int ret;
+
+    if (zone_replace_check(update) < 0) {
+        return -1;
+    }
+    const domain_name_st *zname = domain_name_parse((const char *)update->zone_name);
+    if (zname == NULL) {
+        log_msg(LOG_ERR, "illegal zone name: %s\n", update->zone_name);
+        return -1;
+    }
+    zone_type *zo = domain_store_find_zone(db, zname);
+    free((void *)zname);
+    if (zo == NULL) {
+        log_msg(LOG_ERR, "not find the zone, zone name: %s\n", update->zone_name);
+        return -1;
+    }
+
+    /* the caller owns this db on a single thread, its queries wait for the whole rebuild */
+    delete_zone_rrs(db, zo);
+    if (domaindata_soa_insert(db, update->zone_name, update->has_soa ? &update->soa : NULL) != 0) {
+        log_msg(LOG_ERR, "replace zone %s: soa insert failed\n", update->zone_name);
+        return -1;
+    }
+
+    domain_store_batch_begin(db);
+    while ((ret = zone_replace_next(update, &cur, &rec)) > 0) {
+        if (domaindata_update(db, &rec) != 0) {
+            ++err_num;
+        }
+    }
+    domain_store_batch_end(db);
+    if (ret < 0 || err_num) {
+        log_msg(LOG_ERR, "replace zone %s: %u of %u domains failed\n", update->zone_name, err_num, update->update_num);
+        return -1;
+    }
+    return 0;
+}
@@ -38,8 +38,92 @@ typedef struct domin_info_update {
     struct domin_info_update *next;
 } domin_info_update_st;
 
+typedef struct zone_soa_info {
+    char primary_ns[DB_MAX_NAME_LEN];
+    char mailbox[DB_MAX_NAME_LEN];
+    uint32_t serial;
+    uint32_t refresh;
+    uint32_t retry;
+    uint32_t expire;
+    uint32_t minimum;
+} zone_soa_info_st;
+
+//replace all the domains of one zone at once, the updates are all DOMAN_ACTION_ADD.
+//they are kept in the snapshot record encoding, tens of bytes each instead of a domin_info_update.
+typedef struct zone_replace_update {
+    ctrl_msg cmsg;
+
+    char zone_name[DB_MAX_NAME_LEN];
+    uint8_t has_soa;        //use soa instead of the default one
+    struct zone_soa_info soa;
+    uint32_t update_num;
+    uint32_t data_len;
+    char data[0];
+} zone_replace_update_st;
+
+//one record status as posted, domain_status_build groups them into a domain_status_update.
+typedef struct domain_status_entry {
+    char domain_name[DB_MAX_NAME_LEN];
+    char view_name[MAX_VIEW_NAME_LEN];
+    uint16_t type;
+    uint8_t enabled;
+    uint8_t addr_len;
+    uint8_t addr[16];
+} domain_status_entry_st;
+
+//enable or disable A/AAAA records in place, the health check flips them without delete and add.
+//the statuses are grouped per name, type and view: the names once, then the addresses and an enable bitmap over them.
+typedef struct domain_status_update {
+    ctrl_msg cmsg;
+
+    uint32_t group_num;
+    uint32_t status_num;
+    uint32_t data_len;
+    char data[0];
+} domain_status_update_st;
+
+//one decoded group, addrs and enabled point into the msg data
+typedef struct domain_status_group {
+    char domain_name[DB_MAX_NAME_LEN];
+    char view_name[MAX_VIEW_NAME_LEN];
+    uint16_t type;
+    uint16_t addr_num;
+    uint8_t addr_len;
+    const uint8_t *addrs;
+    const uint8_t *enabled;     //bit i is the status of addrs i
+} domain_status_group_st;
+
+struct snapshot_buf;
+
+/* build a zone replace msg record by record, the header is filled after zone_replace_finish */
+void zone_replace_init(struct snapshot_buf *buf);
+
+void zone_replace_add(struct snapshot_buf *buf, struct domin_info_update *rec);
+
+struct zone_replace_update *zone_replace_finish(struct snapshot_buf *buf);
+
+/* decode the record at *cur, cur starts at update->data. return 1: got rec, 0: end, -1: corrupted */
+int zone_replace_next(const struct zone_replace_update *update, const char **cur, struct domin_info_update *rec);
+
 int domaindata_update(struct domain_store *db, struct domin_info_update *update);
 
-int domaindata_soa_insert(struct domain_store *db, char *zone_name);
+/* sort the entries and encode them as groups in one msg */
+struct domain_status_update *domain_status_build(struct domain_status_entry *entries, uint32_t num);
+
+/* decode the group at *cur, cur starts at update->data. return 1: got group, 0: end, -1: corrupted */
+int domain_status_next(const struct domain_status_update *update, const char **cur, struct domain_status_group *group);
+
+int domaindata_status_update(struct domain_store *db, struct domain_status_update *update);
+
+/* walk all the records of a replace before any is applied, -1 for a corrupted stream or a bad record */
+int zone_replace_check(const struct zone_replace_update *update);
+
+/* -1 leaves the zone partly built, the master then neither journals nor keeps the replace */
+int domaindata_zone_replace(struct domain_store *db, struct zone_replace_update *update);
+
+int domaindata_soa_insert(struct domain_store *db, char *zone_name, struct zone_soa_info *soa);
+
+/* name is the zone itself or below it, case insensitive */
+int domain_name_in_zone(const char *name, const char *zone_name);
 
 #endif
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <arpa/inet.h>
 #include <rte_cfgfile.h>
 #include "dns-conf.h"
 #include "util.h"
@@ -12,6 +13,9 @@
 #include "netdev.h"
 #include "tcp_process.h"
 #include "local_udp_process.h"
+#include "zonefile.h"
+#include "packet.h"
+#include "view.h"
 
 #define UPDATE_ZONES                (0x1 << 0)
 #define UPDATE_FWD_MODE             (0x1 << 1)
@@ -32,6 +36,10 @@ static void dns_config_init(struct dns_config *cfg) {
     cfg->netdev.mbuf_num = 65535;
     cfg->netdev.rxq_desc_num = 1024;
     cfg->netdev.txq_desc_num = 2048;
+    cfg->netdev.port_num = 1;               //port 0
+    cfg->netdev.bond_mode = -1;
+    cfg->netdev.frag_flows = 256;
+    cfg->netdev.frag_timeout_ms = 100;
     strncpy(cfg->netdev.kni_name_prefix, "kdns", sizeof(cfg->netdev.kni_name_prefix) - 1);
     cfg->netdev.kni_mbuf_num = 8191;
 
@@ -44,6 +52,9 @@ static void dns_config_init(struct dns_config *cfg) {
     strncpy(cfg->comm.fwd_def_addrs, "8.8.8.8:53,114.114.114.114:53", sizeof(cfg->comm.fwd_def_addrs) - 1);
     cfg->comm.web_port = 5500;
     cfg->comm.ssl_enable = 0;               //disable ssl
+    cfg->comm.all_down_fallback = 1;        //answer the disabled rrs when all are down
+    cfg->comm.domain_hash_entries = 262144;
+    cfg->comm.view_lpm = 1;
     cfg->comm.all_per_second = 0;           //disable rate-limit
     cfg->comm.fwd_per_second = 0;           //disable fwd rate-limit
     cfg->comm.client_num = 16384;
@@ -141,8 +152,89 @@ static int netdev_config_load(struct rte_cfgfile *cfgfile, struct netdev_config
         return -1;
     }
 
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "ports");
+    if (entry) {
+        int num = netdev_ports_parse(entry, cfg->port_ids, NETDEV_MAX_PORTS);
+        if (num <= 0) {
+            printf("Cannot read NETDEV/ports = %s.\n", entry);
+            return -1;
+        }
+        cfg->port_num = (uint8_t)num;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "bond-mode");
+    if (entry) {
+        cfg->bond_mode = netdev_bond_mode_parse(entry);
+        if (cfg->bond_mode == -2) {
+            printf("Cannot read NETDEV/bond-mode = %s.\n", entry);
+            return -1;
+        }
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "kni-queue");
+    if (entry && (cfg->kni_queue = parser_read_arg_bool(entry)) < 0) {
+        printf("Cannot read NETDEV/kni-queue = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "rss-udp");
+    if (entry && (cfg->rss_udp = parser_read_arg_bool(entry)) < 0) {
+        printf("Cannot read NETDEV/rss-udp = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "reta-interval");
+    if (entry && parser_read_uint32(&cfg->reta_interval, entry) < 0) {
+        printf("Cannot read NETDEV/reta-interval = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "rx-lcores");
+    if (entry && parser_read_uint8(&cfg->rx_lcores, entry) < 0) {
+        printf("Cannot read NETDEV/rx-lcores = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "idle-sleep-us");
+    if (entry && parser_read_uint32(&cfg->idle_sleep_us, entry) < 0) {
+        printf("Cannot read NETDEV/idle-sleep-us = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "power-scale");
+    if (entry && (cfg->power_scale = parser_read_arg_bool(entry)) < 0) {
+        printf("Cannot read NETDEV/power-scale = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "frag-flows");
+    if (entry && parser_read_uint32(&cfg->frag_flows, entry) < 0) {
+        printf("Cannot read NETDEV/frag-flows = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "frag-timeout-ms");
+    if (entry && (parser_read_uint32(&cfg->frag_timeout_ms, entry) < 0 || cfg->frag_timeout_ms == 0)) {
+        printf("Cannot read NETDEV/frag-timeout-ms = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "local-addrs");
+    if (entry) {
+        int num = netdev_local_addrs_parse(entry, cfg->local_addrs, NETDEV_MAX_LOCAL_ADDRS);
+        if (num < 0) {
+            printf("Cannot read NETDEV/local-addrs = %s.\n", entry);
+            return -1;
+        }
+        cfg->local_addr_num = (uint8_t)num;
+    }
+
     entry = rte_cfgfile_get_entry(cfgfile, "NETDEV", "name-prefix");
     if (entry) {
+        if (strlen(entry) >= sizeof(cfg->kni_name_prefix)) {
+            printf("NETDEV/name-prefix = %s is longer than %u chars.\n", entry, (unsigned)sizeof(cfg->kni_name_prefix) - 1);
+            return -1;
+        }
         strncpy(cfg->kni_name_prefix, entry, sizeof(cfg->kni_name_prefix) - 1);
     }
 
@@ -189,6 +281,51 @@ static int common_config_load(struct rte_cfgfile *cfgfile, struct comm_config *c
         return -1;
     }
 
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "zone-files");
+    if (entry) {
+        strncpy(cfg->zone_files, entry, sizeof(cfg->zone_files) - 1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "snapshot-file");
+    if (entry) {
+        strncpy(cfg->snapshot_file, entry, sizeof(cfg->snapshot_file) - 1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "snapshot-interval");
+    if (entry && parser_read_uint32(&cfg->snapshot_interval, entry) < 0) {
+        printf("Cannot read COMMON/snapshot-interval = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "journal-file");
+    if (entry) {
+        strncpy(cfg->journal_file, entry, sizeof(cfg->journal_file) - 1);
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "journal-commit-ms");
+    if (entry && parser_read_uint32(&cfg->journal_commit_ms, entry) < 0) {
+        printf("Cannot read COMMON/journal-commit-ms = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "all-down-fallback");
+    if (entry && (cfg->all_down_fallback = parser_read_arg_bool(entry)) < 0) {
+        printf("Cannot read COMMON/all-down-fallback = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "domain-hash-entries");
+    if (entry && parser_read_uint32(&cfg->domain_hash_entries, entry) < 0) {
+        printf("Cannot read COMMON/domain-hash-entries = %s.\n", entry);
+        return -1;
+    }
+
+    entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "view-lpm");
+    if (entry && (cfg->view_lpm = parser_read_arg_bool(entry)) < 0) {
+        printf("Cannot read COMMON/view-lpm = %s.\n", entry);
+        return -1;
+    }
+
     //fwd config
     entry = rte_cfgfile_get_entry(cfgfile, "COMMON", "fwd-mode");
     if (entry && (cfg->fwd_mode = fwd_mode_parse(entry)) < 0) {
@@ -312,6 +449,22 @@ static void dns_config_dump(struct dns_config *cfg) {
     log_msg(LOG_INFO, "\t txqueue-len: %u\n", cfg->netdev.txq_desc_num);
     log_msg(LOG_INFO, "\t rxqueue-num: %u\n", cfg->netdev.rxq_num);
     log_msg(LOG_INFO, "\t txqueue-num: %u\n", cfg->netdev.txq_num);
+    for (i = 0; i < cfg->netdev.port_num; i++) {
+        log_msg(LOG_INFO, "\t port: %u\n", cfg->netdev.port_ids[i]);
+    }
+    log_msg(LOG_INFO, "\t bond-mode: %s\n", netdev_bond_mode_str(cfg->netdev.bond_mode));
+    log_msg(LOG_INFO, "\t kni-queue: %s\n", cfg->netdev.kni_queue ? "yes" : "no");
+    log_msg(LOG_INFO, "\t rss-udp: %s\n", cfg->netdev.rss_udp ? "yes" : "no");
+    log_msg(LOG_INFO, "\t reta-interval: %u\n", cfg->netdev.reta_interval);
+    log_msg(LOG_INFO, "\t rx-lcores: %u\n", cfg->netdev.rx_lcores);
+    log_msg(LOG_INFO, "\t idle-sleep-us: %u\n", cfg->netdev.idle_sleep_us);
+    log_msg(LOG_INFO, "\t power-scale: %s\n", cfg->netdev.power_scale ? "yes" : "no");
+    log_msg(LOG_INFO, "\t frag-flows: %u\n", cfg->netdev.frag_flows);
+    log_msg(LOG_INFO, "\t frag-timeout-ms: %u\n", cfg->netdev.frag_timeout_ms);
+    for (i = 0; i < cfg->netdev.local_addr_num; i++) {
+        struct in_addr addr = {.s_addr = cfg->netdev.local_addrs[i]};
+        log_msg(LOG_INFO, "\t local-addr: %s\n", inet_ntoa(addr));
+    }
     log_msg(LOG_INFO, "\t name-prefix: %s\n", cfg->netdev.kni_name_prefix);
     log_msg(LOG_INFO, "\t kni-mbuf-num: %u\n", cfg->netdev.kni_mbuf_num);
     log_msg(LOG_INFO, "\t kni-vip: %s\n", cfg->netdev.kni_vip);
@@ -321,6 +474,14 @@ static void dns_config_dump(struct dns_config *cfg) {
     log_msg(LOG_INFO, "\t log-file: %s\n", cfg->comm.log_file);
     log_msg(LOG_INFO, "\t metrics-host: %s\n", cfg->comm.metrics_host);
     log_msg(LOG_INFO, "\t zones: %s\n", cfg->comm.zones);
+    log_msg(LOG_INFO, "\t zone-files: %s\n", cfg->comm.zone_files);
+    log_msg(LOG_INFO, "\t snapshot-file: %s\n", cfg->comm.snapshot_file);
+    log_msg(LOG_INFO, "\t snapshot-interval: %u\n", cfg->comm.snapshot_interval);
+    log_msg(LOG_INFO, "\t journal-file: %s\n", cfg->comm.journal_file);
+    log_msg(LOG_INFO, "\t journal-commit-ms: %u\n", cfg->comm.journal_commit_ms);
+    log_msg(LOG_INFO, "\t all-down-fallback: %d\n", cfg->comm.all_down_fallback);
+    log_msg(LOG_INFO, "\t domain-hash-entries: %u\n", cfg->comm.domain_hash_entries);
+    log_msg(LOG_INFO, "\t view-lpm: %s\n", cfg->comm.view_lpm ? "yes" : "no");
     log_msg(LOG_INFO, "\t fwd-mode: %s\n", fwd_mode_type_str(cfg->comm.fwd_mode));
     log_msg(LOG_INFO, "\t fwd-thread-num: %u\n", cfg->comm.fwd_threads);
     log_msg(LOG_INFO, "\t fwd-timeout: %u\n", cfg->comm.fwd_timeout);
@@ -422,9 +583,6 @@ static int zones_reload_parse(char *new_zones, char *old_zones, char *del_zone,
 }
 
 static int send_config_msg_to_master(struct config_update *msg) {
-    msg->cmsg.type = CTRL_MSG_TYPE_UPDATE_CONFIG;
-    msg->cmsg.len = sizeof(struct config_update);
-
     return ctrl_msg_master_ingress((void **)&msg, 1) == 1 ? 0 : -1;
 }
 
@@ -500,7 +658,7 @@ int dns_config_reload(char *cfgfile_path, char *proc_name) {
         reload_flag |= UPDATE_CLIENT_NUM;
     }
     if (reload_flag) {
-        struct config_update *update = xalloc_zero(sizeof(struct config_update));
+        struct config_update *update = ctrl_msg_alloc(CTRL_MSG_TYPE_UPDATE_CONFIG, sizeof(struct config_update));
 
         update->flags = reload_flag;
         if (update->flags & UPDATE_ZONES) {
@@ -531,6 +689,17 @@ int dns_config_reload(char *cfgfile_path, char *proc_name) {
         old->fwd_per_second = new->fwd_per_second;
         old->client_num = new->client_num;
     }
+
+    //a plain flag read by the lcores on each answer, no msg needed
+    if (new->all_down_fallback != old->all_down_fallback) {
+        log_msg(LOG_INFO, "reload all down fallback, new: %d, old: %d.", new->all_down_fallback, old->all_down_fallback);
+        old->all_down_fallback = new->all_down_fallback;
+        all_down_fallback = new->all_down_fallback;
+    }
+
+    //zone files are checked every time, their content may change without the config.
+    snprintf(old->zone_files, sizeof(old->zone_files), "%s", new->zone_files);
+    zonefiles_load(old->zone_files);
     return 0;
 }
 
@@ -546,7 +715,7 @@ static int dns_config_master_process(ctrl_msg *msg) {
     if (update->flags & (UPDATE_FWD_MODE | UPDATE_FWD_TIMEOUT | UPDATE_FWD_DEF_ADDRS | UPDATE_FWD_ZONES_ADDRS)) {
         fwd_ctrl_master_reload(update->fwd_mode, update->fwd_timeout, update->fwd_def_addrs, update->fwd_zones_addrs);
     }
-    free(update);
+    ctrl_msg_free(msg);
     return 0;
 }
 
@@ -562,7 +731,7 @@ static int dns_config_slave_process(ctrl_msg *msg, unsigned slave_lcore) {
     if (update->flags & (UPDATE_ALL_PER_SECOND | UPDATE_FWD_PER_SECOND | UPDATE_CLIENT_NUM)) {
         rate_limit_reload(update->all_per_second, update->fwd_per_second, update->client_num, slave_lcore);
     }
-    free(update);
+    ctrl_msg_free(msg);
     return 0;
 }
 
@@ -582,6 +751,9 @@ int dns_config_load(char *cfgfile_path, char *proc_name) {
     }
     log_open(g_dns_cfg->comm.log_file);
     dns_config_dump(g_dns_cfg);
+    all_down_fallback = g_dns_cfg->comm.all_down_fallback;
+    domain_hash_entries = g_dns_cfg->comm.domain_hash_entries;
+    view_lpm_enable = g_dns_cfg->comm.view_lpm;
 
     return 0;
 }
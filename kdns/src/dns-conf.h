@@ -30,6 +30,14 @@ struct comm_config {
     char log_file[MAX_CONFIG_STR_LEN];
     char metrics_host[32];
     char zones[MAX_CONFIG_STR_LEN];
+    char zone_files[MAX_CONFIG_STR_LEN];
+    char snapshot_file[MAX_CONFIG_STR_LEN];
+    uint32_t snapshot_interval;
+    char journal_file[MAX_CONFIG_STR_LEN];
+    uint32_t journal_commit_ms;
+    int all_down_fallback;
+    uint32_t domain_hash_entries;
+    int view_lpm;
 
     int fwd_mode;
     uint16_t fwd_threads;
@@ -57,7 +65,21 @@ struct netdev_config {
     uint16_t rxq_num;
     uint16_t txq_num;
 
-    char kni_name_prefix[32];
+    uint8_t port_num;
+    uint8_t port_ids[NETDEV_MAX_PORTS];
+    int bond_mode;         //none: -1, else BONDING_MODE_*
+    int kni_queue;         //extra rx queue of non-dns traffic, polled by master
+    int rss_udp;           //hash the udp ports as well as the addresses
+    uint32_t reta_interval;//seconds between reta rebalances, 0: off
+    uint8_t rx_lcores;     //distributor mode when > 0: slaves polling rx queues for the others
+    uint32_t idle_sleep_us;//max sleep of an idle slave, 0: busy polling
+    int power_scale;       //lower the frequency of a slave sleeping at idle_sleep_us
+    uint32_t frag_flows;   //ipv4 reassembly flows of each slave, 0: fragments go to kni
+    uint32_t frag_timeout_ms;
+    uint8_t local_addr_num;//arp and icmp echo of these are answered by the lcores, not the kernel
+    uint32_t local_addrs[NETDEV_MAX_LOCAL_ADDRS];
+
+    char kni_name_prefix[15];//an interface name is at most 15 chars, leave one for the port index
     uint32_t kni_mbuf_num;
     uint32_t kni_ip;
     char kni_vip[32];
@@ -20,6 +20,9 @@
 #include "hashMap.h"
 #include "metrics.h"
 #include "dns-conf.h"
+#include "zonefile.h"
+#include "snapshot.h"
+#include "journal.h"
 
 #define DOMAIN_HASH_SIZE    (0x3FFFF)
 
@@ -33,6 +36,13 @@ static int g_domain_num;
 static rte_rwlock_t domian_list_lock;
 static struct domin_info_update *g_domian_hash_list[DOMAIN_HASH_SIZE + 1];
 
+//a replaced zone keeps its replace msg with the compact records until a single domain update touches it.
+struct zone_records {
+    struct zone_replace_update *update;
+    struct zone_records *next;
+};
+static struct zone_records *g_zone_records;
+
 static void domain_list_operate(struct domin_info_update *msg, unsigned int hashValue) {
     struct domin_info_update *pre;
     struct domin_info_update *find;
@@ -62,7 +72,7 @@ static void domain_list_operate(struct domin_info_update *msg, unsigned int hash
             g_domain_num++;
             msg->hashValue = hashValue;
         } else {
-            free(msg);
+            ctrl_msg_free(&msg->cmsg);
         }
     } else {
         if (find != NULL && pre != NULL) {
@@ -71,20 +81,79 @@ static void domain_list_operate(struct domin_info_update *msg, unsigned int hash
             } else {
                 pre->next = find->next;
             }
-            free(find);
+            ctrl_msg_free(&find->cmsg);
             g_domain_num--;
         }
-        free(msg);
+        ctrl_msg_free(&msg->cmsg);
     }
 }
 
-static void domain_list_del_pre_zone(char *zone_name) {
+static struct zone_records **zone_records_find(const char *zone_name) {
+    struct zone_records **pos;
+
+    for (pos = &g_zone_records; *pos; pos = &(*pos)->next) {
+        if (strcasecmp((*pos)->update->zone_name, zone_name) == 0) {
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+static void zone_records_del(struct zone_records **pos) {
+    struct zone_records *zone = *pos;
+
+    *pos = zone->next;
+    g_domain_num -= zone->update->update_num;
+    ctrl_msg_free(&zone->update->cmsg);
+    free(zone);
+}
+
+static void zone_records_walk(void *arg, void (*callback)(void *, struct domin_info_update *)) {
+    struct zone_records *zone;
+    struct domin_info_update rec;
+    const char *cur;
+
+    for (zone = g_zone_records; zone; zone = zone->next) {
+        cur = zone->update->data;
+        while (zone_replace_next(zone->update, &cur, &rec) > 0) {
+            callback(arg, &rec);
+        }
+    }
+}
+
+//move the records of a replaced zone to the hash list before a single domain of it is added or deleted
+static void zone_records_expand(const char *zone_name) {
+    struct zone_records **pos = zone_records_find(zone_name);
+    struct domin_info_update rec, *msg;
+    ctrl_msg cmsg;
+    const char *cur;
+
+    if (pos == NULL) {
+        return;
+    }
+    struct zone_replace_update *update = (*pos)->update;
+    cur = update->data;
+    while (zone_replace_next(update, &cur, &rec) > 0) {
+        msg = ctrl_msg_alloc(CTRL_MSG_TYPE_UPDATE_DOMAIN, sizeof(struct domin_info_update));
+        cmsg = msg->cmsg;
+        *msg = rec;
+        msg->cmsg = cmsg;
+        domain_list_operate(msg, elfHashDomain(msg->domain_name));
+    }
+    zone_records_del(pos);
+}
+
+static void do_domain_list_del_zone(char *zone_name) {
     struct domin_info_update *pre;
     struct domin_info_update *find;
     struct domin_info_update *tmp;
+    struct zone_records **pos;
 
-    rte_rwlock_write_lock(&domian_list_lock);
     int i;
+    pos = zone_records_find(zone_name);
+    if (pos) {
+        zone_records_del(pos);
+    }
     for (i = 0; i < DOMAIN_HASH_SIZE; i++) {
         pre = find = g_domian_hash_list[i];
         while (find) {
@@ -97,7 +166,7 @@ static void domain_list_del_pre_zone(char *zone_name) {
                 }
                 tmp = find;
                 find = find->next;
-                free(tmp);
+                ctrl_msg_free(&tmp->cmsg);
                 g_domain_num--;
             } else {
                 pre = find;
@@ -105,6 +174,25 @@ static void domain_list_del_pre_zone(char *zone_name) {
             }
         }
     }
+}
+
+static void domain_list_del_pre_zone(char *zone_name) {
+    rte_rwlock_write_lock(&domian_list_lock);
+    do_domain_list_del_zone(zone_name);
+    rte_rwlock_write_unlock(&domian_list_lock);
+}
+
+static void domain_list_replace_zone(struct zone_replace_update *update) {
+    struct zone_records *zone = xalloc(sizeof(struct zone_records));
+
+    rte_rwlock_write_lock(&domian_list_lock);
+    do_domain_list_del_zone(update->zone_name);
+    //the list holds a reference of the replace msg, it stays after the slaves applied it.
+    rte_atomic32_inc(&update->cmsg.refcnt);
+    zone->update = update;
+    zone->next = g_zone_records;
+    g_zone_records = zone;
+    g_domain_num += update->update_num;
     rte_rwlock_write_unlock(&domian_list_lock);
 }
 
@@ -126,17 +214,43 @@ int domain_list_del_zones(char *zones) {
     return 0;
 }
 
+void domain_list_walk(void *arg, void (*callback)(void *, struct domin_info_update *)) {
+    struct domin_info_update *find;
+    int i;
+
+    rte_rwlock_read_lock(&domian_list_lock);
+    for (i = 0; i <= DOMAIN_HASH_SIZE; i++) {
+        for (find = g_domian_hash_list[i]; find; find = find->next) {
+            callback(arg, find);
+        }
+    }
+    zone_records_walk(arg, callback);
+    rte_rwlock_read_unlock(&domian_list_lock);
+}
+
 static void domain_info_update(struct domin_info_update *msg) {
     rte_rwlock_write_lock(&domian_list_lock);
+    zone_records_expand(msg->zone_name);
     unsigned int hash_v = elfHashDomain(msg->domain_name);
     domain_list_operate(msg, hash_v);
     rte_rwlock_write_unlock(&domian_list_lock);
 }
 
-static int send_domain_msg_to_master(struct domin_info_update *msg) {
-    msg->cmsg.type = CTRL_MSG_TYPE_UPDATE_DOMAIN;
-    msg->cmsg.len = sizeof(struct domin_info_update);
+//the zones of the slaves come from the config, a replace of any other zone would only reach the master
+static int zone_configured(const char *zone_name) {
+    char *name, *tmp;
+    char zones[MAX_CONFIG_STR_LEN] = {0};
 
+    snprintf(zones, sizeof(zones), "%s", g_dns_cfg->comm.zones);
+    for (name = strtok_r(zones, ",", &tmp); name; name = strtok_r(NULL, ",", &tmp)) {
+        if (strcasecmp(name, zone_name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int send_domain_msg_to_master(struct domin_info_update *msg) {
     return ctrl_msg_master_ingress((void **)&msg, 1) == 1 ? 0 : -1;
 }
 
@@ -151,7 +265,7 @@ static inline int ipv6_address_check(const char *str) {
 }
 
 static struct domin_info_update *do_domaindata_parse(enum db_action action, json_t *json_data) {
-    struct domin_info_update *update = xalloc_zero(sizeof(struct domin_info_update));
+    struct domin_info_update *update = ctrl_msg_alloc(CTRL_MSG_TYPE_UPDATE_DOMAIN, sizeof(struct domin_info_update));
     update->action = action;
 
     /* parse json object */
@@ -300,7 +414,7 @@ static struct domin_info_update *do_domaindata_parse(enum db_action action, json
     return update;
 
 _parse_err:
-    free(update);
+    ctrl_msg_free(&update->cmsg);
     return NULL;
 }
 
@@ -410,6 +524,244 @@ _parse_err:
     return (void *)parse_err;
 }
 
+static void *zone_replace_post(struct connection_info_struct *con_info, __attribute__((unused)) char *url, int *len_response) {
+    char *post_ok, *parse_err;
+    struct zone_replace_update *update = NULL;
+    struct snapshot_buf buf;
+
+    buf.data = NULL;
+    log_msg(LOG_INFO, "replace zone data = %s\n", (char *)con_info->uploaddata);
+
+    json_error_t jerror;
+    json_t *json_response = json_loads(con_info->uploaddata, 0, &jerror);
+    if (!json_response) {
+        log_msg(LOG_ERR, "load json string failed: %s %s (line %d, col %d)\n",
+                jerror.text, jerror.source, jerror.line, jerror.column);
+        goto _parse_err;
+    }
+    if (!json_is_object(json_response)) {
+        log_msg(LOG_ERR, "load json string failed: not an object!\n");
+        goto _parse_err;
+    }
+
+    json_t *json_key = json_object_get(json_response, "zoneName");
+    if (!json_key || !json_is_string(json_key) || strlen(json_string_value(json_key)) >= DB_MAX_NAME_LEN) {
+        log_msg(LOG_ERR, "zoneName does not exist or is not string!");
+        goto _parse_err;
+    }
+    const char *zone_name = json_string_value(json_key);
+    if (!zone_configured(zone_name)) {
+        log_msg(LOG_ERR, "zone %s is not configured!\n", zone_name);
+        goto _parse_err;
+    }
+
+    json_t *json_domains = json_object_get(json_response, "domains");
+    if (!json_domains || !json_is_array(json_domains)) {
+        log_msg(LOG_ERR, "domains does not exist or is not an array!");
+        goto _parse_err;
+    }
+
+    size_t domains_count = json_array_size(json_domains);
+    size_t i_num;
+    zone_replace_init(&buf);
+    for (i_num = 0; i_num < domains_count; i_num++) {
+        json_t *array_elem = json_array_get(json_domains, i_num);
+        if (!json_is_object(array_elem)) {
+            log_msg(LOG_ERR, "load json string failed: not an object!\n");
+            goto _parse_err;
+        }
+
+        struct domin_info_update *domain = do_domaindata_parse(DOMAN_ACTION_ADD, array_elem);
+        if (domain == NULL) {
+            goto _parse_err;
+        }
+        if (strcasecmp(domain->zone_name, zone_name) != 0 || !domain_name_in_zone(domain->domain_name, zone_name)) {
+            log_msg(LOG_ERR, "domain %s is not in zone %s!\n", domain->domain_name, zone_name);
+            ctrl_msg_free(&domain->cmsg);
+            goto _parse_err;
+        }
+        zone_replace_add(&buf, domain);
+        ctrl_msg_free(&domain->cmsg);
+    }
+    update = zone_replace_finish(&buf);
+    snprintf(update->zone_name, sizeof(update->zone_name), "%s", zone_name);
+    //checked here so the master and the slaves get a replace they all can apply
+    if (zone_replace_check(update) < 0) {
+        ctrl_msg_free(&update->cmsg);
+        goto _parse_err;
+    }
+    json_decref(json_response);
+
+    if (ctrl_msg_master_ingress((void **)&update, 1) != 1) {
+        parse_err = strdup("send msg err\n");
+        *len_response = strlen(parse_err);
+        return (void *)parse_err;
+    }
+
+    post_ok = strdup("OK\n");
+    *len_response = strlen(post_ok);
+    return (void *)post_ok;
+
+_parse_err:
+    free(buf.data);
+    if (json_response) {
+        json_decref(json_response);
+    }
+    parse_err = strdup("parse data err\n");
+    *len_response = strlen(parse_err);
+    return (void *)parse_err;
+}
+
+static int do_domain_status_parse(json_t *json_data, struct domain_status_entry *status) {
+    const char *value;
+
+    json_t *json_key = json_object_get(json_data, "domainName");
+    if (!json_key || !json_is_string(json_key) || strlen(json_string_value(json_key)) >= DB_MAX_NAME_LEN) {
+        log_msg(LOG_ERR, "domainName does not exist or is not string!");
+        return -1;
+    }
+    snprintf(status->domain_name, sizeof(status->domain_name), "%s", json_string_value(json_key));
+
+    json_key = json_object_get(json_data, "viewName");
+    if (!json_key || !json_is_string(json_key)) {
+        snprintf(status->view_name, sizeof(status->view_name), "%s", DEFAULT_VIEW_NAME);
+    } else {
+        snprintf(status->view_name, sizeof(status->view_name), "%s", json_string_value(json_key));
+    }
+
+    json_key = json_object_get(json_data, "type");
+    if (!json_key || !json_is_string(json_key)) {
+        log_msg(LOG_ERR, "type does not exist or is not string!");
+        return -1;
+    }
+    value = json_string_value(json_key);
+    if (strcmp(value, "A") == 0) {
+        status->type = TYPE_A;
+        status->addr_len = 4;
+    } else if (strcmp(value, "AAAA") == 0) {
+        status->type = TYPE_AAAA;
+        status->addr_len = 16;
+    } else {
+        log_msg(LOG_ERR, "type not support!");
+        return -1;
+    }
+
+    json_key = json_object_get(json_data, "host");
+    if (!json_key || !json_is_string(json_key)
+            || inet_pton(status->type == TYPE_A ? AF_INET : AF_INET6, json_string_value(json_key), status->addr) <= 0) {
+        log_msg(LOG_ERR, "host does not exist or is bad ip addr!");
+        return -1;
+    }
+
+    json_key = json_object_get(json_data, "enable");
+    if (!json_key || !json_is_boolean(json_key)) {
+        log_msg(LOG_ERR, "enable does not exist or is not bool!");
+        return -1;
+    }
+    status->enabled = json_is_true(json_key);
+    return 0;
+}
+
+static void *domain_status_post(struct connection_info_struct *con_info, __attribute__((unused)) char *url, int *len_response) {
+    char *post_ok, *parse_err;
+    struct domain_status_update *update = NULL;
+    struct domain_status_entry *entries = NULL;
+
+    log_msg(LOG_INFO, "domain status data = %s\n", (char *)con_info->uploaddata);
+
+    json_error_t jerror;
+    json_t *json_response = json_loads(con_info->uploaddata, 0, &jerror);
+    if (!json_response) {
+        log_msg(LOG_ERR, "load json string failed: %s %s (line %d, col %d)\n",
+                jerror.text, jerror.source, jerror.line, jerror.column);
+        goto _parse_err;
+    }
+
+    json_t *json_domains = json_object_get(json_response, "domains");
+    if (!json_domains || !json_is_array(json_domains)) {
+        log_msg(LOG_ERR, "domains does not exist or is not an array!");
+        goto _parse_err;
+    }
+
+    size_t domains_count = json_array_size(json_domains);
+    size_t i_num;
+    entries = xalloc_array_zero(domains_count ? domains_count : 1, sizeof(struct domain_status_entry));
+    for (i_num = 0; i_num < domains_count; i_num++) {
+        json_t *array_elem = json_array_get(json_domains, i_num);
+        if (!json_is_object(array_elem) || do_domain_status_parse(array_elem, &entries[i_num]) < 0) {
+            goto _parse_err;
+        }
+    }
+    update = domain_status_build(entries, domains_count);
+    free(entries);
+    json_decref(json_response);
+
+    if (ctrl_msg_master_ingress((void **)&update, 1) != 1) {
+        parse_err = strdup("send msg err\n");
+        *len_response = strlen(parse_err);
+        return (void *)parse_err;
+    }
+
+    post_ok = strdup("OK\n");
+    *len_response = strlen(post_ok);
+    return (void *)post_ok;
+
+_parse_err:
+    free(entries);
+    if (json_response) {
+        json_decref(json_response);
+    }
+    parse_err = strdup("parse data err\n");
+    *len_response = strlen(parse_err);
+    return (void *)parse_err;
+}
+
+static void *zonefile_post(struct connection_info_struct *con_info, __attribute__((unused)) char *url, int *len_response) {
+    char *post_ok, *parse_err;
+
+    if (con_info->uploaddata == NULL) {
+        goto _parse_err;
+    }
+    log_msg(LOG_INFO, "zone file upload, len = %zu\n", con_info->data_buffer_offset);
+
+    struct zone_replace_update *update = zonefile_parse(NULL, con_info->uploaddata);
+    if (update == NULL) {
+        goto _parse_err;
+    }
+    if (!zone_configured(update->zone_name) || zone_replace_check(update) < 0) {
+        log_msg(LOG_ERR, "zone %s is not configured or has bad records!\n", update->zone_name);
+        ctrl_msg_free(&update->cmsg);
+        goto _parse_err;
+    }
+    if (ctrl_msg_master_ingress((void **)&update, 1) != 1) {
+        parse_err = strdup("send msg err\n");
+        *len_response = strlen(parse_err);
+        return (void *)parse_err;
+    }
+
+    post_ok = strdup("OK\n");
+    *len_response = strlen(post_ok);
+    return (void *)post_ok;
+
+_parse_err:
+    parse_err = strdup("parse data err\n");
+    *len_response = strlen(parse_err);
+    return (void *)parse_err;
+}
+
+static void *snapshot_post(__attribute__((unused)) struct connection_info_struct *con_info, __attribute__((unused)) char *url, int *len_response) {
+    char *post_ok, *post_err;
+
+    if (snapshot_dump(g_dns_cfg->comm.snapshot_file) < 0) {
+        post_err = strdup("snapshot err\n");
+        *len_response = strlen(post_err);
+        return (void *)post_err;
+    }
+    post_ok = strdup("OK\n");
+    *len_response = strlen(post_ok);
+    return (void *)post_ok;
+}
+
 static void *domain_post(struct connection_info_struct *con_info, __attribute__((unused)) char *url, int *len_response) {
     return domaindata_parse(DOMAN_ACTION_ADD, con_info, len_response);
 }
@@ -426,6 +778,104 @@ static void *domain_del(struct connection_info_struct *con_info, __attribute__((
     return domaindata_parse(DOMAN_ACTION_DEL, con_info, len_response);
 }
 
+static json_t *domain_json_pack(struct domin_info_update *domain) {
+    json_t *value = NULL;
+
+    switch (domain->type) {
+    case TYPE_A:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "A",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "viewName", domain->view_name, "ttl", domain->ttl, "maxAnswer", domain->maxAnswer,
+                          "lbMode", domain->lb_mode, "lbWeight", domain->lb_weight);
+        break;
+    case TYPE_AAAA:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "AAAA",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "viewName", domain->view_name, "ttl", domain->ttl, "maxAnswer", domain->maxAnswer,
+                          "lbMode", domain->lb_mode, "lbWeight", domain->lb_weight);
+        break;
+    case TYPE_PTR:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i}", "type", "PTR",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "viewName", domain->view_name, "ttl", domain->ttl, "maxAnswer", domain->maxAnswer);
+        break;
+    case TYPE_CNAME:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i}", "type", "CNAME",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "viewName", domain->view_name, "ttl", domain->ttl, "maxAnswer", domain->maxAnswer);
+        break;
+    case TYPE_SRV:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i, s:i}", "type", "SRV",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "viewName", domain->view_name, "ttl", domain->ttl, "priority", domain->prio,
+                          "weight", domain->weight, "port", domain->port, "maxAnswer", domain->maxAnswer);
+        break;
+    default:
+        log_msg(LOG_ERR, "wrong type(%d) domain:%s\n", domain->type, domain->domain_name);
+    }
+    return value;
+}
+
+static void domains_json_put(void *arg, struct domin_info_update *domain) {
+    json_t *value = domain_json_pack(domain);
+    if (value) {
+        json_array_append_new((json_t *)arg, value);
+    }
+}
+
+static json_t *domain_brief_json_pack(struct domin_info_update *domain) {
+    json_t *value = NULL;
+
+    switch (domain->type) {
+    case TYPE_A:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "A",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "viewName", domain->view_name, "ttl", domain->ttl, "maxAnswer", domain->maxAnswer,
+                          "lbMode", domain->lb_mode, "lbWeight", domain->lb_weight);
+        break;
+    case TYPE_AAAA:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "AAAA",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "viewName", domain->view_name, "ttl", domain->ttl, "maxAnswer", domain->maxAnswer,
+                          "lbMode", domain->lb_mode, "lbWeight", domain->lb_weight);
+        break;
+    case TYPE_PTR:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:i}", "type", "PTR",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "ttl", domain->ttl);
+        break;
+    case TYPE_CNAME:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:i}", "type", "CNAME",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "ttl", domain->ttl);
+        break;
+    case TYPE_SRV:
+        value = json_pack("{s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "SRV",
+                          "domainName", domain->domain_name, "host", domain->host, "zoneName", domain->zone_name,
+                          "ttl", domain->ttl, "priority", domain->prio, "weight", domain->weight, "port", domain->port);
+        break;
+    default:
+        log_msg(LOG_ERR, "wrong type(%d) domain:%s\n", domain->type, domain->domain_name);
+    }
+    return value;
+}
+
+struct domain_get_arg {
+    json_t *array;
+    const char *domain;
+};
+
+static void domain_json_put(void *arg, struct domin_info_update *domain) {
+    struct domain_get_arg *get_arg = (struct domain_get_arg *)arg;
+
+    if (strcmp(domain->domain_name, get_arg->domain) == 0) {
+        json_t *value = domain_brief_json_pack(domain);
+        if (value) {
+            json_array_append_new(get_arg->array, value);
+        }
+    }
+}
+
 static void *domains_get(__attribute__((unused)) struct connection_info_struct *con_info, __attribute__((unused)) char *url, int *len_response) {
     log_msg(LOG_INFO, "domain_get() in \n");
 
@@ -439,52 +889,7 @@ static void *domains_get(__attribute__((unused)) struct connection_info_struct *
         return (void *)out_err;
     }
 
-    json_t *value = NULL;
-    struct domin_info_update *domain_info;
-
-    rte_rwlock_read_lock(&domian_list_lock);
-    int i;
-    for (i = 0; i < DOMAIN_HASH_SIZE; i++) {
-        domain_info = g_domian_hash_list[i];
-        while (domain_info) {
-            switch (domain_info->type) {
-            case TYPE_A:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "A",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "viewName", domain_info->view_name, "ttl", domain_info->ttl, "maxAnswer", domain_info->maxAnswer,
-                                  "lbMode", domain_info->lb_mode, "lbWeight", domain_info->lb_weight);
-                break;
-            case TYPE_AAAA:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "AAAA",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "viewName", domain_info->view_name, "ttl", domain_info->ttl, "maxAnswer", domain_info->maxAnswer,
-                                  "lbMode", domain_info->lb_mode, "lbWeight", domain_info->lb_weight);
-                break;
-            case TYPE_PTR:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i}", "type", "PTR",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "viewName", domain_info->view_name, "ttl", domain_info->ttl, "maxAnswer", domain_info->maxAnswer);
-                break;
-            case TYPE_CNAME:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i}", "type", "CNAME",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "viewName", domain_info->view_name, "ttl", domain_info->ttl, "maxAnswer", domain_info->maxAnswer);
-                break;
-            case TYPE_SRV:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i, s:i}", "type", "SRV",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "viewName", domain_info->view_name, "ttl", domain_info->ttl, "priority", domain_info->prio,
-                                  "weight", domain_info->weight, "port", domain_info->port, "maxAnswer", domain_info->maxAnswer);
-                break;
-            default:
-                log_msg(LOG_ERR, "wrong type(%d) domain:%s\n", domain_info->type, domain_info->domain_name);
-            }
-
-            json_array_append_new(array, value);
-            domain_info = domain_info->next;
-        }
-    }
-    rte_rwlock_read_unlock(&domian_list_lock);
+    domain_list_walk(array, domains_json_put);
 
     char *str_ret = json_dumps(array, JSON_COMPACT);
     json_decref(array);
@@ -513,47 +918,21 @@ static void *domain_get(__attribute__((unused)) struct connection_info_struct *c
 
     unsigned int hashValue = elfHashDomain(domain);
     unsigned int hashId = hashValue & DOMAIN_HASH_SIZE;
+    struct domain_get_arg get_arg = {array, domain};
 
     rte_rwlock_read_lock(&domian_list_lock);
     struct domin_info_update *domain_info = g_domian_hash_list[hashId];
     while (domain_info) {
         if (domain_info->hashValue == hashValue &&
             strcmp(domain_info->domain_name, domain) == 0) {
-            switch (domain_info->type) {
-            case TYPE_A:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "A",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "viewName", domain_info->view_name, "ttl", domain_info->ttl, "maxAnswer", domain_info->maxAnswer,
-                                  "lbMode", domain_info->lb_mode, "lbWeight", domain_info->lb_weight);
-                break;
-            case TYPE_AAAA:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "AAAA",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "viewName", domain_info->view_name, "ttl", domain_info->ttl, "maxAnswer", domain_info->maxAnswer,
-                                  "lbMode", domain_info->lb_mode, "lbWeight", domain_info->lb_weight);
-                break;
-            case TYPE_PTR:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:i}", "type", "PTR",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "ttl", domain_info->ttl);
-                break;
-            case TYPE_CNAME:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:i}", "type", "CNAME",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "ttl", domain_info->ttl);
-                break;
-            case TYPE_SRV:
-                value = json_pack("{s:s, s:s, s:s, s:s, s:i, s:i, s:i, s:i}", "type", "SRV",
-                                  "domainName", domain_info->domain_name, "host", domain_info->host, "zoneName", domain_info->zone_name,
-                                  "ttl", domain_info->ttl, "priority", domain_info->prio, "weight", domain_info->weight, "port", domain_info->port);
-                break;
-            default:
-                log_msg(LOG_ERR, "wrong type(%d) domain:%s\n", domain_info->type, domain_info->domain_name);
+            value = domain_brief_json_pack(domain_info);
+            if (value) {
+                json_array_append_new(array, value);
             }
-            json_array_append_new(array, value);
         }
         domain_info = domain_info->next;
     }
+    zone_records_walk(&get_arg, domain_json_put);
     rte_rwlock_read_unlock(&domian_list_lock);
 
     char *str_ret = json_dumps(array, JSON_COMPACT);
@@ -605,11 +984,13 @@ static void *statistics_percore_get(__attribute__((unused)) struct connection_in
 
         json_t *value = json_pack("{s:i, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f,\
                                     s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f,\
-                                    s:f, s:f, s:f, s:f, s:f}",
+                                    s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f}",
                                   "slave_lcore", lcore_id, "pkts_rcv", (double)sta_lcore->pkts_rcv,
                                   "dns_pkts_rcv", (double)sta_lcore->dns_pkts_rcv, "dns_pkts_snd", (double)sta_lcore->dns_pkts_snd,
                                   "pkt_dropped", (double)sta_lcore->pkt_dropped, "pkts_2kni", (double)sta_lcore->pkts_2kni,
                                   "pkts_icmp", (double)sta_lcore->pkts_icmp, "pkt_len_err", (double)sta_lcore->pkt_len_err,
+                                  "pkts_arp", (double)sta_lcore->pkts_arp,
+                                  "pkts_frag", (double)sta_lcore->pkts_frag, "frag_dropped", (double)sta_lcore->frag_dropped,
                                   "dns_lens_rcv", (double)sta_lcore->dns_lens_rcv, "dns_lens_snd", (double)sta_lcore->dns_lens_snd,
                                   "tcp_pkts_rcv", (double)sta_lcore->dns_pkts_rcv_tcp, "tcp_pkts_snd", (double)sta_lcore->dns_pkts_snd_tcp,
                                   "tcp_fwd_rcv", (double)sta_lcore->dns_fwd_rcv_tcp, "tcp_fwd_snd", (double)sta_lcore->dns_fwd_snd_tcp,
@@ -641,11 +1022,13 @@ static void *statistics_get(__attribute__((unused)) struct connection_info_struc
 
     json_t *value = json_pack("{s:i, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f,\
                                 s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f,\
-                                s:f, s:f, s:f, s:f, s:f}",
+                                s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f}",
                               "domain_num", domain_num_get(), "pkts_rcv", (double)sta.pkts_rcv,
                               "dns_pkts_rcv", (double)sta.dns_pkts_rcv, "dns_pkts_snd", (double)sta.dns_pkts_snd,
                               "pkt_dropped", (double)sta.pkt_dropped, "pkts_2kni", (double)sta.pkts_2kni,
                               "pkts_icmp", (double)sta.pkts_icmp, "pkt_len_err", (double)sta.pkt_len_err,
+                              "pkts_arp", (double)sta.pkts_arp,
+                              "pkts_frag", (double)sta.pkts_frag, "frag_dropped", (double)sta.frag_dropped,
                               "dns_lens_rcv", (double)sta.dns_lens_rcv, "dns_lens_snd", (double)sta.dns_lens_snd,
                               "tcp_pkts_rcv", (double)sta.dns_pkts_rcv_tcp, "tcp_pkts_snd", (double)sta.dns_pkts_snd_tcp,
                               "tcp_fwd_rcv", (double)sta.dns_fwd_rcv_tcp, "tcp_fwd_snd", (double)sta.dns_fwd_snd_tcp,
@@ -679,18 +1062,10 @@ static void *statistics_reset(__attribute__((unused)) struct connection_info_str
 }
 
 static void *statistics_port_get(__attribute__((unused)) struct connection_info_struct *con_info, __attribute__((unused)) char *url, int *len_response) {
-    uint8_t port_id = 0;
+    uint8_t i, port_id;
     unsigned lcore_id;
     struct rte_eth_stats eth_stats;
 
-    int ret = rte_eth_stats_get(port_id, &eth_stats);
-    if (ret != 0) {
-        char *err = strdup("unable to get eth stats");
-        *len_response = strlen(err);
-        log_msg(LOG_ERR, "%s, ret %d\n", err, ret);
-        return (void *)err;
-    }
-
     json_t *array = json_array();
     if (!array) {
         char *err = strdup("unable to create array");
@@ -699,51 +1074,60 @@ static void *statistics_port_get(__attribute__((unused)) struct connection_info_
         return (void *)err;
     }
 
-    json_t *value = json_pack("{s:i, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f}",
-                              "port", port_id, "ipackets", (double)eth_stats.ipackets,
-                              "opackets", (double)eth_stats.opackets, "ibytes", (double)eth_stats.ibytes,
-                              "obytes", (double)eth_stats.obytes, "imissed", (double)eth_stats.imissed,
-                              "ierrors", (double)eth_stats.ierrors, "oerrors", (double)eth_stats.oerrors,
-                              "rx_nombuf", (double)eth_stats.rx_nombuf);
+    for (i = 0; i < netif_port_num(); i++) {
+        port_id = netif_port_id(i);
+        int ret = rte_eth_stats_get(port_id, &eth_stats);
+        if (ret != 0) {
+            log_msg(LOG_ERR, "unable to get eth stats of port %u, ret %d\n", port_id, ret);
+            continue;
+        }
 
-    if (!value) {
-        log_msg(LOG_ERR, "json_pack err for port %u\n", port_id);
-    } else {
-        json_array_append_new(array, value);
-    }
+        json_t *value = json_pack("{s:i, s:f, s:f, s:f, s:f, s:f, s:f, s:f, s:f}",
+                                  "port", port_id, "ipackets", (double)eth_stats.ipackets,
+                                  "opackets", (double)eth_stats.opackets, "ibytes", (double)eth_stats.ibytes,
+                                  "obytes", (double)eth_stats.obytes, "imissed", (double)eth_stats.imissed,
+                                  "ierrors", (double)eth_stats.ierrors, "oerrors", (double)eth_stats.oerrors,
+                                  "rx_nombuf", (double)eth_stats.rx_nombuf);
 
-    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
-        json_t *value = NULL;
-        struct netif_queue_conf *conf = netif_queue_conf_get(lcore_id);
-        if (conf->rx_queue_id < RTE_ETHDEV_QUEUE_STAT_CNTRS && conf->tx_queue_id < RTE_ETHDEV_QUEUE_STAT_CNTRS) {
-            value = json_pack("{s:i, s:i, s:i, s:f, s:f, s:f, s:f, s:f}",
-                              "slave_lcore", lcore_id, "rx_queue", conf->rx_queue_id, "tx_queue", conf->tx_queue_id,
-                              "q_ipackets", (double)eth_stats.q_ipackets[conf->rx_queue_id],
-                              "q_opackets", (double)eth_stats.q_opackets[conf->tx_queue_id],
-                              "q_ibytes", (double)eth_stats.q_ibytes[conf->rx_queue_id],
-                              "q_obytes", (double)eth_stats.q_obytes[conf->tx_queue_id],
-                              "q_errors", (double)eth_stats.q_errors[conf->rx_queue_id]);
-        } else if (conf->rx_queue_id < RTE_ETHDEV_QUEUE_STAT_CNTRS) {
-            value = json_pack("{s:i, s:i, s:f, s:f, s:f}",
-                              "slave_lcore", lcore_id, "rx_queue", conf->rx_queue_id,
-                              "q_ipackets", (double)eth_stats.q_ipackets[conf->rx_queue_id],
-                              "q_ibytes", (double)eth_stats.q_ibytes[conf->rx_queue_id],
-                              "q_errors", (double)eth_stats.q_errors[conf->rx_queue_id]);
-        } else if (conf->tx_queue_id < RTE_ETHDEV_QUEUE_STAT_CNTRS) {
-            value = json_pack("{s:i, s:i, s:f, s:f}",
-                              "slave_lcore", lcore_id, "tx_queue", conf->tx_queue_id,
-                              "q_opackets", (double)eth_stats.q_opackets[conf->tx_queue_id],
-                              "q_obytes", (double)eth_stats.q_obytes[conf->tx_queue_id]);
+        if (!value) {
+            log_msg(LOG_ERR, "json_pack err for port %u\n", port_id);
         } else {
-            continue;
+            json_array_append_new(array, value);
         }
 
-        if (!value) {
-            log_msg(LOG_ERR, "json_pack err for slave core %u, rx queue %u, tx queue %u\n",
-                    lcore_id, conf->rx_queue_id, conf->tx_queue_id);
-            continue;
+        RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+            json_t *value = NULL;
+            struct netif_queue_conf *conf = netif_queue_conf_get(lcore_id);
+            if (conf->rx_queue_id < RTE_ETHDEV_QUEUE_STAT_CNTRS && conf->tx_queue_id < RTE_ETHDEV_QUEUE_STAT_CNTRS) {
+                value = json_pack("{s:i, s:i, s:i, s:i, s:f, s:f, s:f, s:f, s:f}",
+                                  "port", port_id, "slave_lcore", lcore_id, "rx_queue", conf->rx_queue_id, "tx_queue", conf->tx_queue_id,
+                                  "q_ipackets", (double)eth_stats.q_ipackets[conf->rx_queue_id],
+                                  "q_opackets", (double)eth_stats.q_opackets[conf->tx_queue_id],
+                                  "q_ibytes", (double)eth_stats.q_ibytes[conf->rx_queue_id],
+                                  "q_obytes", (double)eth_stats.q_obytes[conf->tx_queue_id],
+                                  "q_errors", (double)eth_stats.q_errors[conf->rx_queue_id]);
+            } else if (conf->rx_queue_id < RTE_ETHDEV_QUEUE_STAT_CNTRS) {
+                value = json_pack("{s:i, s:i, s:i, s:f, s:f, s:f}",
+                                  "port", port_id, "slave_lcore", lcore_id, "rx_queue", conf->rx_queue_id,
+                                  "q_ipackets", (double)eth_stats.q_ipackets[conf->rx_queue_id],
+                                  "q_ibytes", (double)eth_stats.q_ibytes[conf->rx_queue_id],
+                                  "q_errors", (double)eth_stats.q_errors[conf->rx_queue_id]);
+            } else if (conf->tx_queue_id < RTE_ETHDEV_QUEUE_STAT_CNTRS) {
+                value = json_pack("{s:i, s:i, s:i, s:f, s:f}",
+                                  "port", port_id, "slave_lcore", lcore_id, "tx_queue", conf->tx_queue_id,
+                                  "q_opackets", (double)eth_stats.q_opackets[conf->tx_queue_id],
+                                  "q_obytes", (double)eth_stats.q_obytes[conf->tx_queue_id]);
+            } else {
+                continue;
+            }
+
+            if (!value) {
+                log_msg(LOG_ERR, "json_pack err for port %u, slave core %u, rx queue %u, tx queue %u\n",
+                        port_id, lcore_id, conf->rx_queue_id, conf->tx_queue_id);
+                continue;
+            }
+            json_array_append_new(array, value);
         }
-        json_array_append_new(array, value);
     }
 
     char *str_ret = json_dumps(array, JSON_COMPACT);
@@ -753,9 +1137,11 @@ static void *statistics_port_get(__attribute__((unused)) struct connection_info_
 }
 
 static void *statistics_port_reset(__attribute__((unused)) struct connection_info_struct *con_info, __attribute__((unused)) char *url, int *len_response) {
-    uint8_t port_id = 0;
+    uint8_t i;
 
-    rte_eth_stats_reset(port_id);
+    for (i = 0; i < netif_port_num(); i++) {
+        rte_eth_stats_reset(netif_port_id(i));
+    }
 
     char *post_ok = strdup("OK\n");
     *len_response = strlen(post_ok);
@@ -778,6 +1164,10 @@ void domian_info_exchange_run(uint16_t web_port, int ssl_enable, char *key_pem_f
     web_endpoint_add("GET", "/kdns/perdomain/", dins, &domain_get);
     web_endpoint_add("DELETE", "/kdns/domain", dins, &domain_del);
     web_endpoint_add("DELETE", "/kdns/alldomains", dins, &domains_delete_all);
+    web_endpoint_add("POST", "/kdns/zone/replace", dins, &zone_replace_post);
+    web_endpoint_add("POST", "/kdns/domain/status", dins, &domain_status_post);
+    web_endpoint_add("POST", "/kdns/zonefile", dins, &zonefile_post);
+    web_endpoint_add("POST", "/kdns/snapshot", dins, &snapshot_post);
 
     web_endpoint_add("POST", "/kdns/status", dins, &kdns_status_post);
     web_endpoint_add("GET", "/kdns/status", dins, &kdns_status_get);
@@ -813,7 +1203,7 @@ void domian_info_exchange_run(uint16_t web_port, int ssl_enable, char *key_pem_f
 
 static int domain_msg_slave_process(ctrl_msg *msg, unsigned slave_lcore) {
     int ret = domaindata_update(dpdk_dns[slave_lcore].db, (struct domin_info_update *)msg);
-    free(msg);
+    ctrl_msg_free(msg);
     return ret;
 }
 
@@ -822,7 +1212,51 @@ static int domain_msg_master_process(ctrl_msg *msg) {
 
     tcp_domian_databd_update(update);
     local_udp_domian_databd_update(update);
+    //domain_info_update keeps or frees the msg, journal it first
+    journal_lock();
+    journal_append(msg);
     domain_info_update(update);
+    journal_unlock();
+    return 0;
+}
+
+static int zone_replace_msg_slave_process(ctrl_msg *msg, unsigned slave_lcore) {
+    int ret = domaindata_zone_replace(dpdk_dns[slave_lcore].db, (struct zone_replace_update *)msg);
+    ctrl_msg_free(msg);
+    return ret;
+}
+
+static int zone_replace_msg_master_process(ctrl_msg *msg) {
+    struct zone_replace_update *update = (struct zone_replace_update *)msg;
+
+    //the posts check the zone and its records before the msg reaches the slaves, tcp fails like them
+    if (tcp_zone_replace(update) < 0) {
+        log_msg(LOG_ERR, "replace zone %s failed, not journaled\n", update->zone_name);
+        ctrl_msg_free(msg);
+        return -1;
+    }
+    local_udp_zone_replace(update);
+    journal_lock();
+    journal_append(msg);
+    domain_list_replace_zone(update);
+    journal_unlock();
+    ctrl_msg_free(msg);
+    return 0;
+}
+
+static int domain_status_msg_slave_process(ctrl_msg *msg, unsigned slave_lcore) {
+    int ret = domaindata_status_update(dpdk_dns[slave_lcore].db, (struct domain_status_update *)msg);
+    ctrl_msg_free(msg);
+    return ret;
+}
+
+//health state is not kept in the domain list, it is lost with a restart like the checker's own
+static int domain_status_msg_master_process(ctrl_msg *msg) {
+    struct domain_status_update *update = (struct domain_status_update *)msg;
+
+    tcp_domain_status_update(update);
+    local_udp_domain_status_update(update);
+    ctrl_msg_free(msg);
     return 0;
 }
 
@@ -830,6 +1264,8 @@ void domain_info_master_init(void) {
     int i;
 
     ctrl_msg_reg(CTRL_MSG_TYPE_UPDATE_DOMAIN, CTRL_MSG_FLAG_MASTER_SYNC_SLAVE, domain_msg_master_process, domain_msg_slave_process);
+    ctrl_msg_reg(CTRL_MSG_TYPE_REPLACE_ZONE, CTRL_MSG_FLAG_MASTER_SYNC_SLAVE, zone_replace_msg_master_process, zone_replace_msg_slave_process);
+    ctrl_msg_reg(CTRL_MSG_TYPE_DOMAIN_STATUS, CTRL_MSG_FLAG_MASTER_SYNC_SLAVE, domain_status_msg_master_process, domain_status_msg_slave_process);
 
     kdns_status = strdup(DNS_STATUS_INIT);
     rte_rwlock_init(&domian_list_lock);
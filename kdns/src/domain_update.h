@@ -10,6 +10,8 @@ void domian_info_exchange_run(uint16_t web_port, int ssl_enable, char *key_pem_f
 
 int domain_list_del_zones(char *del_zones);
 
+void domain_list_walk(void *arg, void (*callback)(void *, struct domin_info_update *));
+
 void domain_info_master_init(void);
 
 #endif
@@ -245,12 +245,10 @@ static int fwd_query_response(fwd_manage *manage, fwd_qnode *query) {
     udp_hdr = rte_pktmbuf_mtod_offset(query->pkt, struct udp_hdr *, ip_hdr_offset);
     query_data = rte_pktmbuf_mtod_offset(query->pkt, uint8_t *, udp_hdr_offset);
 
-    init_dns_packet_header(eth_hdr, ipv4_hdr, udp_hdr, manage->rwlen);
+    init_dns_packet_header(query->pkt, eth_hdr, ipv4_hdr, udp_hdr, manage->rwlen);
     query->pkt->pkt_len = manage->rwlen + udp_hdr_offset;
     query->pkt->data_len = query->pkt->pkt_len;
-    query->pkt->l2_len = sizeof(struct ether_hdr);
     query->pkt->vlan_tci = ETHER_TYPE_IPv4;
-    query->pkt->l3_len = sizeof(struct ipv4_hdr);
     memcpy(query_data, manage->rwbuf, manage->rwlen);
 
     uint16_t orig_id = htons(query->id);
@@ -1091,7 +1089,7 @@ int fwd_server_init(void) {
         log_msg(LOG_ERR, "Failed to create fwd query ring: %s\n", rte_strerror(rte_errno));
         exit(-1);
     }
-    g_fwd_response_ring = rte_ring_create("fwd_response_ring", FWD_RING_SIZE, rte_socket_id(), RING_F_SC_DEQ);
+    g_fwd_response_ring = rte_ring_create("fwd_response_ring", FWD_RING_SIZE, rte_lcore_to_socket_id(rte_get_master_lcore()), RING_F_SC_DEQ);
     if (!g_fwd_response_ring) {
         log_msg(LOG_ERR, "Failed to create fwd response ring: %s\n", rte_strerror(rte_errno));
         exit(-1);
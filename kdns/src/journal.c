@@ -0,0 +1,509 @@
+/*
+ * journal.c
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <rte_atomic.h>
+#include <rte_hash_crc.h>
+
+#include "util.h"
+#include "db_update.h"
+#include "view_update.h"
+#include "snapshot.h"
+#include "journal.h"
+
+#define JOURNAL_MAGIC           (0x4B444A4E)
+#define JOURNAL_INIT_BUF_SIZE   (1 << 16)
+#define JOURNAL_DEF_COMMIT_MS   (100)
+
+/* every entry is the header plus len bytes payload, checksum covers both */
+struct journal_entry {
+    uint32_t magic;
+    uint32_t len;
+    uint32_t checksum;
+    uint16_t type;
+    uint16_t action;
+    uint64_t generation;
+};
+
+static int journal_fd = -1;
+static char *journal_path;
+static uint32_t journal_commit_ms;
+static rte_atomic64_t journal_gen;
+
+static struct snapshot_buf journal_pending;
+static pthread_mutex_t journal_buf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t journal_file_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t journal_apply_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the zones replaced by the entries to replay, filled by journal_scan */
+struct journal_zone {
+    char zone_name[DB_MAX_NAME_LEN];
+    struct journal_zone *next;
+};
+static struct journal_zone *journal_zones;
+
+static void journal_zone_encode(struct snapshot_buf *buf, struct zone_replace_update *update) {
+    snapshot_buf_put_str(buf, update->zone_name, sizeof(update->zone_name));
+    snapshot_buf_put(buf, &update->has_soa, sizeof(update->has_soa));
+    if (update->has_soa) {
+        snapshot_buf_put_str(buf, update->soa.primary_ns, sizeof(update->soa.primary_ns));
+        snapshot_buf_put_str(buf, update->soa.mailbox, sizeof(update->soa.mailbox));
+        snapshot_buf_put(buf, &update->soa.serial, sizeof(update->soa.serial));
+        snapshot_buf_put(buf, &update->soa.refresh, sizeof(update->soa.refresh));
+        snapshot_buf_put(buf, &update->soa.retry, sizeof(update->soa.retry));
+        snapshot_buf_put(buf, &update->soa.expire, sizeof(update->soa.expire));
+        snapshot_buf_put(buf, &update->soa.minimum, sizeof(update->soa.minimum));
+    }
+    snapshot_buf_put(buf, &update->update_num, sizeof(update->update_num));
+    snapshot_buf_put(buf, update->data, update->data_len);
+}
+
+static ctrl_msg *journal_zone_decode(const char *cur, const char *end) {
+    struct zone_replace_update header;
+    struct domin_info_update rec;
+    uint32_t i = 0;
+    int ret;
+
+    memset(&header, 0, sizeof(header));
+    if (snapshot_get_str(&cur, end, header.zone_name, sizeof(header.zone_name)) < 0
+            || snapshot_get(&cur, end, &header.has_soa, sizeof(header.has_soa)) < 0) {
+        return NULL;
+    }
+    if (header.has_soa && (snapshot_get_str(&cur, end, header.soa.primary_ns, sizeof(header.soa.primary_ns)) < 0
+            || snapshot_get_str(&cur, end, header.soa.mailbox, sizeof(header.soa.mailbox)) < 0
+            || snapshot_get(&cur, end, &header.soa.serial, sizeof(header.soa.serial)) < 0
+            || snapshot_get(&cur, end, &header.soa.refresh, sizeof(header.soa.refresh)) < 0
+            || snapshot_get(&cur, end, &header.soa.retry, sizeof(header.soa.retry)) < 0
+            || snapshot_get(&cur, end, &header.soa.expire, sizeof(header.soa.expire)) < 0
+            || snapshot_get(&cur, end, &header.soa.minimum, sizeof(header.soa.minimum)) < 0)) {
+        return NULL;
+    }
+    if (snapshot_get(&cur, end, &header.update_num, sizeof(header.update_num)) < 0
+            || header.update_num > (uint32_t)(end - cur)) {
+        return NULL;
+    }
+
+    //the records are kept encoded, check them once here so the consumers can trust the count
+    uint32_t data_len = end - cur;
+    struct zone_replace_update *update = ctrl_msg_alloc(CTRL_MSG_TYPE_REPLACE_ZONE,
+            sizeof(struct zone_replace_update) + data_len);
+    memcpy(update->zone_name, header.zone_name, sizeof(update->zone_name));
+    update->has_soa = header.has_soa;
+    update->soa = header.soa;
+    update->update_num = header.update_num;
+    update->data_len = data_len;
+    memcpy(update->data, cur, data_len);
+
+    cur = update->data;
+    while ((ret = zone_replace_next(update, &cur, &rec)) > 0) {
+        ++i;
+    }
+    if (ret < 0 || i != update->update_num) {
+        ctrl_msg_free(&update->cmsg);
+        return NULL;
+    }
+    return &update->cmsg;
+}
+
+static ctrl_msg *journal_entry_decode(struct journal_entry *entry, const char *cur) {
+    const char *end = cur + entry->len;
+
+    switch (entry->type) {
+    case CTRL_MSG_TYPE_UPDATE_DOMAIN: {
+        struct domin_info_update *update = ctrl_msg_alloc(CTRL_MSG_TYPE_UPDATE_DOMAIN, sizeof(struct domin_info_update));
+        update->action = entry->action;
+        if (snapshot_domain_decode(&cur, end, update) < 0) {
+            ctrl_msg_free(&update->cmsg);
+            return NULL;
+        }
+        return &update->cmsg;
+    }
+    case CTRL_MSG_TYPE_UPDATE_VIEW: {
+        struct view_info_update *update = ctrl_msg_alloc(CTRL_MSG_TYPE_UPDATE_VIEW, sizeof(struct view_info_update));
+        update->action = entry->action;
+        if (snapshot_get_str(&cur, end, update->cidrs, sizeof(update->cidrs)) < 0
+                || snapshot_get_str(&cur, end, update->view_name, sizeof(update->view_name)) < 0) {
+            ctrl_msg_free(&update->cmsg);
+            return NULL;
+        }
+        return &update->cmsg;
+    }
+    case CTRL_MSG_TYPE_REPLACE_ZONE:
+        return journal_zone_decode(cur, end);
+    default:
+        return NULL;
+    }
+}
+
+static uint32_t journal_entry_checksum(const struct journal_entry *entry, const char *payload) {
+    uint32_t crc = rte_hash_crc_4byte(entry->len, 0);
+    crc = rte_hash_crc_4byte(((uint32_t)entry->type << 16) | entry->action, crc);
+    crc = rte_hash_crc_8byte(entry->generation, crc);
+    return rte_hash_crc(payload, entry->len, crc);
+}
+
+/* return the payload of the entry at *cur, NULL for a torn or corrupted entry */
+static const char *journal_entry_next(const char **cur, const char *end, struct journal_entry *entry) {
+    const char *payload = *cur + sizeof(*entry);
+
+    if (*cur + sizeof(*entry) > end) {
+        return NULL;
+    }
+    memcpy(entry, *cur, sizeof(*entry));
+    if (entry->magic != JOURNAL_MAGIC || entry->len > (uint32_t)(end - payload)
+            || journal_entry_checksum(entry, payload) != entry->checksum) {
+        return NULL;
+    }
+    *cur = payload + entry->len;
+    return payload;
+}
+
+void journal_append(ctrl_msg *msg) {
+    struct journal_entry entry;
+    uint32_t off;
+
+    if (journal_fd < 0 || msg->no_journal) {
+        return;
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    entry.magic = JOURNAL_MAGIC;
+    entry.type = msg->type;
+
+    pthread_mutex_lock(&journal_buf_lock);
+    off = journal_pending.len;
+    snapshot_buf_put(&journal_pending, &entry, sizeof(entry));
+    switch (msg->type) {
+    case CTRL_MSG_TYPE_UPDATE_DOMAIN:
+        entry.action = ((struct domin_info_update *)msg)->action;
+        snapshot_domain_encode(&journal_pending, (struct domin_info_update *)msg);
+        break;
+    case CTRL_MSG_TYPE_UPDATE_VIEW: {
+        struct view_info_update *view = (struct view_info_update *)msg;
+        entry.action = view->action;
+        snapshot_buf_put_str(&journal_pending, view->cidrs, sizeof(view->cidrs));
+        snapshot_buf_put_str(&journal_pending, view->view_name, sizeof(view->view_name));
+        break;
+    }
+    case CTRL_MSG_TYPE_REPLACE_ZONE:
+        journal_zone_encode(&journal_pending, (struct zone_replace_update *)msg);
+        break;
+    default:
+        journal_pending.len = off;
+        pthread_mutex_unlock(&journal_buf_lock);
+        return;
+    }
+    entry.generation = rte_atomic64_add_return(&journal_gen, 1);
+    entry.len = journal_pending.len - off - sizeof(entry);
+    entry.checksum = journal_entry_checksum(&entry, journal_pending.data + off + sizeof(entry));
+    memcpy(journal_pending.data + off, &entry, sizeof(entry));
+    pthread_mutex_unlock(&journal_buf_lock);
+}
+
+void journal_lock(void) {
+    pthread_mutex_lock(&journal_apply_lock);
+}
+
+void journal_unlock(void) {
+    pthread_mutex_unlock(&journal_apply_lock);
+}
+
+uint64_t journal_generation(void) {
+    uint64_t generation;
+
+    pthread_mutex_lock(&journal_apply_lock);
+    generation = (uint64_t)rte_atomic64_read(&journal_gen);
+    pthread_mutex_unlock(&journal_apply_lock);
+    return generation;
+}
+
+static int journal_write(int fd, const char *data, uint32_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* caller holds journal_file_lock, the api and master threads are never blocked on the disk */
+static int journal_flush(void) {
+    struct snapshot_buf buf;
+    int ret = 0;
+
+    pthread_mutex_lock(&journal_buf_lock);
+    buf = journal_pending;
+    if (buf.len > 0) {
+        journal_pending.data = xalloc(JOURNAL_INIT_BUF_SIZE);
+        journal_pending.size = JOURNAL_INIT_BUF_SIZE;
+        journal_pending.len = 0;
+    }
+    pthread_mutex_unlock(&journal_buf_lock);
+    if (buf.len == 0) {
+        return 0;
+    }
+
+    if (journal_write(journal_fd, buf.data, buf.len) < 0 || fdatasync(journal_fd) < 0) {
+        log_msg(LOG_ERR, "write journal %s failed, errno=%d, errinfo=%s\n", journal_path, errno, strerror(errno));
+        ret = -1;
+    }
+    free(buf.data);
+    return ret;
+}
+
+static void *thread_journal_commit(__attribute__((unused)) void *arg) {
+    while (1) {
+        usleep(journal_commit_ms * 1000);
+        pthread_mutex_lock(&journal_file_lock);
+        journal_flush();
+        pthread_mutex_unlock(&journal_file_lock);
+    }
+    return NULL;
+}
+
+int journal_compact(uint64_t generation) {
+    struct journal_entry entry;
+    struct stat st;
+    char tmp_path[PATH_MAX];
+    int ret = -1;
+
+    if (journal_fd < 0) {
+        return 0;
+    }
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", journal_path);
+
+    pthread_mutex_lock(&journal_file_lock);
+    journal_flush();
+    if (fstat(journal_fd, &st) < 0) {
+        goto out;
+    }
+    int tmp_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (tmp_fd < 0) {
+        log_msg(LOG_ERR, "open journal %s failed, errno=%d, errinfo=%s\n", tmp_path, errno, strerror(errno));
+        goto out;
+    }
+
+    if (st.st_size > 0) {
+        int fd = open(journal_path, O_RDONLY);
+        void *addr = (fd < 0) ? MAP_FAILED : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (addr == MAP_FAILED) {
+            log_msg(LOG_ERR, "mmap journal %s failed, errno=%d, errinfo=%s\n", journal_path, errno, strerror(errno));
+            close(tmp_fd);
+            unlink(tmp_path);
+            goto out;
+        }
+
+        //keep the entries newer than the snapshot, they were applied while it was dumped
+        const char *cur = (const char *)addr;
+        const char *end = cur + st.st_size;
+        const char *start = cur;
+        int write_err = 0;
+        while (!write_err && journal_entry_next(&cur, end, &entry) != NULL) {
+            if (entry.generation > generation) {
+                write_err = journal_write(tmp_fd, start, cur - start);
+            }
+            start = cur;
+        }
+        munmap(addr, st.st_size);
+        if (write_err) {
+            log_msg(LOG_ERR, "write journal %s failed, errno=%d, errinfo=%s\n", tmp_path, errno, strerror(errno));
+            close(tmp_fd);
+            unlink(tmp_path);
+            goto out;
+        }
+    }
+
+    if (fsync(tmp_fd) < 0 || rename(tmp_path, journal_path) < 0) {
+        log_msg(LOG_ERR, "compact journal %s failed, errno=%d, errinfo=%s\n", journal_path, errno, strerror(errno));
+        close(tmp_fd);
+        unlink(tmp_path);
+        goto out;
+    }
+    close(tmp_fd);
+
+    int fd = open(journal_path, O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        log_msg(LOG_ERR, "reopen journal %s failed, errno=%d, errinfo=%s\n", journal_path, errno, strerror(errno));
+        goto out;
+    }
+    close(journal_fd);
+    journal_fd = fd;
+    ret = 0;
+
+out:
+    pthread_mutex_unlock(&journal_file_lock);
+    return ret;
+}
+
+static int journal_replay(const char *path, uint64_t generation) {
+    struct journal_entry entry;
+    struct stat st;
+    uint32_t replay_num = 0;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        log_msg(LOG_ERR, "open journal %s failed, errno=%d, errinfo=%s\n", path, errno, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        log_msg(LOG_ERR, "mmap journal %s failed, errno=%d, errinfo=%s\n", path, errno, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    const char *cur = (const char *)addr;
+    const char *end = cur + st.st_size;
+    const char *payload;
+    while ((payload = journal_entry_next(&cur, end, &entry)) != NULL) {
+        if (entry.generation > (uint64_t)rte_atomic64_read(&journal_gen)) {
+            rte_atomic64_set(&journal_gen, entry.generation);
+        }
+        if (entry.generation <= generation) {
+            continue;
+        }
+        ctrl_msg *msg = journal_entry_decode(&entry, payload);
+        if (msg == NULL) {
+            log_msg(LOG_ERR, "journal %s: bad entry, generation %lu\n", path, (unsigned long)entry.generation);
+            continue;
+        }
+        msg->no_journal = 1;
+        ctrl_msg_master_ingress_wait((void **)&msg, 1);
+        replay_num++;
+    }
+
+    //a crash in the middle of a write leaves a torn tail, cut it before appending
+    off_t good_len = (const char *)cur - (const char *)addr;
+    if (good_len < st.st_size) {
+        log_msg(LOG_ERR, "journal %s: drop %ld bytes torn tail\n", path, (long)(st.st_size - good_len));
+        if (ftruncate(fd, good_len) < 0) {
+            log_msg(LOG_ERR, "truncate journal %s failed, errno=%d, errinfo=%s\n", path, errno, strerror(errno));
+        }
+    }
+    munmap(addr, st.st_size);
+    close(fd);
+
+    log_msg(LOG_INFO, "replay journal %s: %u entries after generation %lu, now generation %lu\n", path,
+            replay_num, (unsigned long)generation, (unsigned long)journal_generation());
+    return 0;
+}
+
+int journal_scan(const char *path, uint64_t generation) {
+    struct journal_entry entry;
+    struct stat st;
+
+    if (path == NULL || strlen(path) == 0) {
+        return 0;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        log_msg(LOG_ERR, "mmap journal %s failed, errno=%d, errinfo=%s\n", path, errno, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    const char *cur = (const char *)addr;
+    const char *end = cur + st.st_size;
+    const char *payload;
+    while ((payload = journal_entry_next(&cur, end, &entry)) != NULL) {
+        if (entry.generation <= generation || entry.type != CTRL_MSG_TYPE_REPLACE_ZONE) {
+            continue;
+        }
+        struct journal_zone *zone = xalloc_zero(sizeof(struct journal_zone));
+        if (snapshot_get_str(&payload, payload + entry.len, zone->zone_name, sizeof(zone->zone_name)) < 0) {
+            free(zone);
+            continue;
+        }
+        zone->next = journal_zones;
+        journal_zones = zone;
+    }
+    munmap(addr, st.st_size);
+    close(fd);
+    return 0;
+}
+
+int journal_zone_replaced(const char *zone_name) {
+    struct journal_zone *zone;
+
+    for (zone = journal_zones; zone; zone = zone->next) {
+        if (strcasecmp(zone->zone_name, zone_name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int journal_init(const char *path, uint32_t commit_ms, uint64_t generation) {
+    pthread_t thread_id;
+
+    rte_atomic64_init(&journal_gen);
+    rte_atomic64_set(&journal_gen, generation);
+    if (path == NULL || strlen(path) == 0) {
+        return 0;
+    }
+    int ret = journal_replay(path, generation);
+    while (journal_zones) {
+        struct journal_zone *zone = journal_zones;
+        journal_zones = zone->next;
+        free(zone);
+    }
+    if (ret < 0) {
+        return -1;
+    }
+
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) {
+        log_msg(LOG_ERR, "open journal %s failed, errno=%d, errinfo=%s\n", path, errno, strerror(errno));
+        return -1;
+    }
+    journal_path = strdup(path);
+    journal_commit_ms = commit_ms ? commit_ms : JOURNAL_DEF_COMMIT_MS;
+    journal_pending.data = xalloc(JOURNAL_INIT_BUF_SIZE);
+    journal_pending.size = JOURNAL_INIT_BUF_SIZE;
+    journal_pending.len = 0;
+    journal_fd = fd;
+
+    if (pthread_create(&thread_id, NULL, thread_journal_commit, NULL) != 0) {
+        log_msg(LOG_ERR, "create journal commit thread failed\n");
+        return -1;
+    }
+    pthread_setname_np(thread_id, "kdns_journal");
+    pthread_detach(thread_id);
+    return 0;
+}
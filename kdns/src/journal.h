@@ -0,0 +1,30 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdint.h>
+#include "ctrl_msg.h"
+
+/* note the zones replaced by the entries newer than generation, before journal_init replays them */
+int journal_scan(const char *path, uint64_t generation);
+
+/* the replay of the scanned journal replaces zone_name, a startup load of its file would be overwritten */
+int journal_zone_replaced(const char *zone_name);
+
+/* replay the entries newer than generation, then append to path and commit every commit_ms */
+int journal_init(const char *path, uint32_t commit_ms, uint64_t generation);
+
+/* called on master when a domain, zone or view msg is applied to the registry */
+void journal_append(ctrl_msg *msg);
+
+/* held around journal_append and the registry change, so a generation never runs ahead of the registry */
+void journal_lock(void);
+
+void journal_unlock(void);
+
+/* every msg up to the returned generation is already in the registry */
+uint64_t journal_generation(void);
+
+/* drop the entries a snapshot of generation already covers */
+int journal_compact(uint64_t generation);
+
+#endif  /* _JOURNAL_H_ */
@@ -71,7 +71,7 @@ static void kdns_zones_soa_create(struct domain_store *db, char *zones) {
     strncpy(zone_tmp, zones, sizeof(zone_tmp) - 1);
     name = strtok_r(zone_tmp, ",", &tmp);
     while (name) {
-        domaindata_soa_insert(db, name);
+        domaindata_soa_insert(db, name, NULL);
         name = strtok_r(0, ",", &tmp);
     }
     return;
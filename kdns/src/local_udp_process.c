@@ -213,6 +213,20 @@ int local_udp_domian_databd_update(struct domin_info_update *update) {
     return ret;
 }
 
+int local_udp_zone_replace(struct zone_replace_update *update) {
+    rte_rwlock_write_lock(&local_udp_lock);
+    int ret = domaindata_zone_replace(local_udp_kdns.db, update);
+    rte_rwlock_write_unlock(&local_udp_lock);
+    return ret;
+}
+
+int local_udp_domain_status_update(struct domain_status_update *update) {
+    rte_rwlock_write_lock(&local_udp_lock);
+    int ret = domaindata_status_update(local_udp_kdns.db, update);
+    rte_rwlock_write_unlock(&local_udp_lock);
+    return ret;
+}
+
 int local_udp_zones_reload(char *del_zones, char *add_zones) {
     //log_msg(LOG_INFO, "local udp reload zones: del: %s, add: %s.\n", del_zones, add_zones);
     rte_rwlock_write_lock(&local_udp_lock);
@@ -8,6 +8,10 @@ int local_udp_process_init(void);
 
 int local_udp_domian_databd_update(struct domin_info_update *update);
 
+int local_udp_zone_replace(struct zone_replace_update *update);
+
+int local_udp_domain_status_update(struct domain_status_update *update);
+
 int local_udp_zones_reload(char *del_zones, char *add_zones);
 
 #endif  /* _LOCAL_UDP_PROCESS_H_ */
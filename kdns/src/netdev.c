@@ -11,11 +11,17 @@
 #include "rte_mbuf.h"
 #include "rte_ethdev.h"
 #include "rte_kni.h"
+#include "rte_eth_bond.h"
+#include "rte_flow.h"
+#include "rte_malloc.h"
 #include <rte_ip.h>
 #include <rte_udp.h>
+#include <rte_arp.h>
+#include <rte_icmp.h>
 #include "netdev.h"
 #include "dns-conf.h"
 #include "util.h"
+#include "parser.h"
 #include "process.h"
 #include "ctrl_msg.h"
 
@@ -31,9 +37,17 @@
 
 #define MBUF_CACHE_DEF          (256)
 
-struct rte_kni *kdns_kni;
+#define BOND_PORT_NAME          "net_bond0"
 
-struct rte_mempool *pkt_mbuf_pool;
+#define FRAG_TBL_BUCKET_ENTRIES (16)
+
+/* fewer rx pkts in an interval are not worth moving buckets for */
+#define RETA_REBALANCE_MIN_HITS (10000)
+/* buckets moved per interval at most, each move reorders the flows of a bucket */
+#define RETA_REBALANCE_MAX_MOVES (32)
+
+/* rx mbufs come from the pool of the socket of the polling lcore */
+static struct rte_mempool *pkt_mbuf_pools[RTE_MAX_NUMA_NODES];
 
 struct rte_mempool *kni_mbuf_pool;
 
@@ -84,6 +98,83 @@ int netdev_mode_parse(const char *entry) {
     }
 }
 
+int netdev_ports_parse(const char *entry, uint8_t *port_ids, int max_num) {
+    int num = 0;
+    char *tmp, *token;
+    char ports[MAX_CONFIG_STR_LEN] = {0};
+
+    strncpy(ports, entry, sizeof(ports) - 1);
+    for (token = strtok_r(ports, ",", &tmp); token; token = strtok_r(NULL, ",", &tmp)) {
+        if (num == max_num || parser_read_uint8(&port_ids[num], token) < 0) {
+            return -1;
+        }
+        ++num;
+    }
+    return num;
+}
+
+int netdev_local_addrs_parse(const char *entry, uint32_t *addrs, int max_num) {
+    int num = 0;
+    char *tmp, *token;
+    struct in_addr addr;
+    char list[MAX_CONFIG_STR_LEN] = {0};
+
+    strncpy(list, entry, sizeof(list) - 1);
+    for (token = strtok_r(list, ",", &tmp); token; token = strtok_r(NULL, ",", &tmp)) {
+        if (num == max_num || parse_ipv4_addr(token, &addr) < 0) {
+            return -1;
+        }
+        addrs[num++] = addr.s_addr;
+    }
+    return num;
+}
+
+static const struct {
+    const char *name;
+    int mode;
+} bond_mode_table[] = {
+    {"none",            -1},
+    {"lacp",            BONDING_MODE_8023AD},
+    {"active-backup",   BONDING_MODE_ACTIVE_BACKUP},
+    {"balance",         BONDING_MODE_BALANCE},
+};
+
+int netdev_bond_mode_parse(const char *entry) {
+    uint8_t i;
+    for (i = 0; i < RTE_DIM(bond_mode_table); i++) {
+        if (strcasecmp(entry, bond_mode_table[i].name) == 0) {
+            return bond_mode_table[i].mode;
+        }
+    }
+    return -2;
+}
+
+const char *netdev_bond_mode_str(int mode) {
+    uint8_t i;
+    for (i = 0; i < RTE_DIM(bond_mode_table); i++) {
+        if (bond_mode_table[i].mode == mode) {
+            return bond_mode_table[i].name;
+        }
+    }
+    return "unknown";
+}
+
+uint8_t netif_port_num(void) {
+    return kdns_net_device.port_num;
+}
+
+uint8_t netif_port_id(uint8_t idx) {
+    return kdns_net_device.port_ids[idx];
+}
+
+uint16_t netif_worker_num(void) {
+    return kdns_net_device.worker_num;
+}
+
+unsigned netif_worker_lcore(uint16_t idx) {
+    return kdns_net_device.workers[idx];
+}
+
 static char *flowtype_to_str(uint16_t flow_type) {
     struct flow_type_info {
         char str[32];
@@ -143,7 +234,7 @@ static void check_port_flow_type_rss_offloads(uint8_t port_id) {
 }
 
 /* Check the link status of all ports in up to 9s, and print them finally */
-static void check_all_ports_link_status(uint8_t port_num, uint32_t port_mask) {
+static void check_all_ports_link_status(uint8_t port_num, uint64_t port_mask) {
 #define CHECK_INTERVAL 100 /* 100ms */
 #define MAX_CHECK_TIME 90 /* 9s (90 * 100ms) in total */
     uint8_t portid, count, all_ports_up, print_flag = 0;
@@ -153,7 +244,7 @@ static void check_all_ports_link_status(uint8_t port_num, uint32_t port_mask) {
     for (count = 0; count <= MAX_CHECK_TIME; count++) {
         all_ports_up = 1;
         for (portid = 0; portid < port_num; portid++) {
-            if ((port_mask & (1 << portid)) == 0) {
+            if ((port_mask & (1ULL << portid)) == 0) {
                 continue;
             }
             memset(&link, 0, sizeof(link));
@@ -196,54 +287,547 @@ struct netif_queue_conf *netif_queue_conf_get(uint16_t lcore_id) {
     return &kdns_net_device.l_netif_queue_conf[lcore_id];
 }
 
-static void netif_queue_core_bind(uint8_t port_id) {
-    int rx_id = 0;
-    int tx_id = 0;
-    int port_socket_id = rte_eth_dev_socket_id(port_id);
+/* in distributor mode the first rx-lcores slaves poll the rx queues and the others transmit on their own tx queue */
+static void netif_queue_core_bind(void) {
+    uint8_t i;
+    uint16_t idx = 0;
+    unsigned lcore_id;
+    struct netif_queue_conf *conf;
+    uint8_t rx_lcores = g_dns_cfg->netdev.rx_lcores;
+
+    kdns_net_device.worker_num = 0;
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        conf = &kdns_net_device.l_netif_queue_conf[lcore_id];
+        memset(conf, 0, sizeof(struct netif_queue_conf));
+        conf->port_num = kdns_net_device.port_num;
+        memcpy(conf->port_ids, kdns_net_device.port_ids, sizeof(conf->port_ids));
+        if (rx_lcores == 0) {
+            conf->role = NETIF_ROLE_RXTX;
+            conf->role_idx = idx;
+            conf->rx_queue_id = idx;
+            conf->tx_queue_id = idx;
+            kdns_net_device.workers[kdns_net_device.worker_num++] = lcore_id;
+        } else if (idx < rx_lcores) {
+            conf->role = NETIF_ROLE_RX;
+            conf->role_idx = idx;
+            conf->rx_queue_id = idx;
+            conf->tx_queue_id = NETIF_QUEUE_NONE;
+        } else {
+            conf->role = NETIF_ROLE_WORKER;
+            conf->role_idx = idx - rx_lcores;
+            conf->rx_queue_id = NETIF_QUEUE_NONE;
+            conf->tx_queue_id = idx - rx_lcores;
+            kdns_net_device.workers[kdns_net_device.worker_num++] = lcore_id;
+        }
+        ++idx;
+
+        for (i = 0; i < conf->port_num; i++) {
+            log_msg(LOG_INFO, "core queue info: coreId(%d) coreSocketId(%u) role(%u) portID(%d) portSocketId(%d) rxQueueId(%d) txQueueId(%d)\n",
+                    lcore_id, lcore_config[lcore_id].socket_id, conf->role, conf->port_ids[i], rte_eth_dev_socket_id(conf->port_ids[i]),
+                    conf->rx_queue_id, conf->tx_queue_id);
+        }
+    }
+}
+
+/* the socket of the slave lcore that uses queue_id, else the socket of the port */
+static int netif_queue_socket_id(uint8_t port_id, uint16_t queue_id, int is_tx) {
+    unsigned lcore_id;
+    int socket_id;
+    struct netif_queue_conf *conf;
+
+    if (!is_tx && kdns_net_device.kni_queue && queue_id == kdns_net_device.kni_queue_id) {
+        return (int)rte_lcore_to_socket_id(rte_get_master_lcore());
+    }
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        conf = &kdns_net_device.l_netif_queue_conf[lcore_id];
+        if ((is_tx ? conf->tx_queue_id : conf->rx_queue_id) == queue_id) {
+            return (int)rte_lcore_to_socket_id(lcore_id);
+        }
+    }
+    socket_id = rte_eth_dev_socket_id(port_id);
+    return socket_id < 0 ? 0 : socket_id;
+}
+
+static struct rte_mempool *netif_pktmbuf_pool_get(int socket_id) {
+    char name[32];
+    unsigned nb_mbuf = g_dns_cfg->netdev.mbuf_num;
+
+    if (pkt_mbuf_pools[socket_id] == NULL) {
+        snprintf(name, sizeof(name), "pkt_mbuf_pool_%d", socket_id);
+        pkt_mbuf_pools[socket_id] = rte_pktmbuf_pool_create(name, nb_mbuf, MBUF_CACHE_DEF, 0, RTE_MBUF_DEFAULT_BUF_SIZE, socket_id);
+        if (pkt_mbuf_pools[socket_id] == NULL) {
+            log_msg(LOG_ERR, "Could not initialise %s\n", name);
+            exit(-1);
+        }
+        log_msg(LOG_INFO, "%s created, mbufs(%u)\n", name, nb_mbuf);
+    }
+    return pkt_mbuf_pools[socket_id];
+}
+
+/* single producer and consumer, placed on the socket of the consumer */
+static void netif_queue_rings_init(void) {
+    uint8_t d;
+    char name[32];
     unsigned lcore_id;
+    struct netif_queue_conf *conf;
 
     RTE_LCORE_FOREACH_SLAVE(lcore_id) {
-        log_msg(LOG_INFO, "core queue info: coreId(%d) coreSocketId(%u) portID(%d) portSocketId(%d) rxQueueId(%d) txQueueId(%d)\n",
-                lcore_id, lcore_config[lcore_id].socket_id, port_id, port_socket_id, rx_id, tx_id);
+        conf = &kdns_net_device.l_netif_queue_conf[lcore_id];
 
-        memset(&kdns_net_device.l_netif_queue_conf[lcore_id], 0, sizeof(struct netif_queue_conf));
-        kdns_net_device.l_netif_queue_conf[lcore_id].port_id = port_id;
-        kdns_net_device.l_netif_queue_conf[lcore_id].rx_queue_id = rx_id;
-        kdns_net_device.l_netif_queue_conf[lcore_id].tx_queue_id = tx_id;
+        snprintf(name, sizeof(name), "kni_ring_%u", lcore_id);
+        conf->kni_ring = rte_ring_create(name, NETIF_RING_SIZE, rte_lcore_to_socket_id(rte_get_master_lcore()), RING_F_SP_ENQ | RING_F_SC_DEQ);
+        if (conf->kni_ring == NULL) {
+            log_msg(LOG_ERR, "Cannot create %s\n", name);
+            exit(-1);
+        }
+
+        snprintf(name, sizeof(name), "tx_ring_%u", lcore_id);
+        conf->tx_ring = rte_ring_create(name, NETIF_RING_SIZE, rte_lcore_to_socket_id(lcore_id), RING_F_SP_ENQ | RING_F_SC_DEQ);
+        if (conf->tx_ring == NULL) {
+            log_msg(LOG_ERR, "Cannot create %s\n", name);
+            exit(-1);
+        }
 
-        if (rx_id < RTE_ETHDEV_QUEUE_STAT_CNTRS) {
-            rte_eth_dev_set_rx_queue_stats_mapping(port_id, rx_id, rx_id);
+        if (conf->role != NETIF_ROLE_WORKER) {
+            continue;
         }
-        if (tx_id < RTE_ETHDEV_QUEUE_STAT_CNTRS) {
-            rte_eth_dev_set_tx_queue_stats_mapping(port_id, tx_id, tx_id);
+        for (d = 0; d < g_dns_cfg->netdev.rx_lcores; d++) {
+            snprintf(name, sizeof(name), "dist_ring_%u_%u", d, lcore_id);
+            conf->dist_rings[d] = rte_ring_create(name, NETIF_RING_SIZE, rte_lcore_to_socket_id(lcore_id), RING_F_SP_ENQ | RING_F_SC_DEQ);
+            if (conf->dist_rings[d] == NULL) {
+                log_msg(LOG_ERR, "Cannot create %s\n", name);
+                exit(-1);
+            }
         }
+    }
+}
 
-        ++rx_id;
-        ++tx_id;
+/* the lcores polling rx queues count the hits of each reta bucket, after the ports know their reta */
+static void netif_reta_hits_init(void) {
+    uint8_t i;
+    unsigned lcore_id;
+    struct netif_queue_conf *conf;
+
+    if (g_dns_cfg->netdev.reta_interval == 0) {
+        return;
+    }
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        conf = &kdns_net_device.l_netif_queue_conf[lcore_id];
+        if (conf->rx_queue_id == NETIF_QUEUE_NONE) {
+            continue;
+        }
+        conf->reta_hits = rte_zmalloc_socket("reta_hits", NETDEV_MAX_PORTS * NETIF_RETA_MAX * sizeof(uint32_t),
+                                             RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore_id));
+        if (conf->reta_hits == NULL) {
+            log_msg(LOG_ERR, "Cannot alloc reta hits of core %u\n", lcore_id);
+            exit(-1);
+        }
+        for (i = 0; i < kdns_net_device.port_num; i++) {
+            conf->reta_mask[i] = kdns_net_device.reta_size[i] ? kdns_net_device.reta_size[i] - 1 : 0;
+        }
     }
 }
 
-static void kdns_port_init(uint8_t port_id) {
+/* a flow holds at most RTE_LIBRTE_IP_FRAG_MAX_FRAG mbufs, fragments beyond frag-flows are dropped */
+static void netif_frag_tbl_init(void) {
+    unsigned lcore_id;
+    struct netif_queue_conf *conf;
+    uint32_t flows = g_dns_cfg->netdev.frag_flows;
+    uint64_t frag_cycles = (rte_get_tsc_hz() + 999) / 1000 * g_dns_cfg->netdev.frag_timeout_ms;
+
+    if (flows == 0) {
+        return;
+    }
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        conf = &kdns_net_device.l_netif_queue_conf[lcore_id];
+        if (conf->role == NETIF_ROLE_RX) {
+            continue;
+        }
+        conf->frag_tbl = rte_ip_frag_table_create((flows + FRAG_TBL_BUCKET_ENTRIES - 1) / FRAG_TBL_BUCKET_ENTRIES,
+                                                  FRAG_TBL_BUCKET_ENTRIES, flows, frag_cycles, rte_lcore_to_socket_id(lcore_id));
+        if (conf->frag_tbl == NULL) {
+            log_msg(LOG_ERR, "Cannot create frag table of core %u\n", lcore_id);
+            exit(-1);
+        }
+    }
+}
+
+static void netif_queue_stats_mapping(uint8_t port_id, uint16_t nb_rx_q, uint16_t nb_tx_q) {
+    uint16_t q;
+
+    for (q = 0; q < nb_rx_q && q < RTE_ETHDEV_QUEUE_STAT_CNTRS; ++q) {
+        rte_eth_dev_set_rx_queue_stats_mapping(port_id, q, q);
+    }
+    for (q = 0; q < nb_tx_q && q < RTE_ETHDEV_QUEUE_STAT_CNTRS; ++q) {
+        rte_eth_dev_set_tx_queue_stats_mapping(port_id, q, q);
+    }
+}
+
+static uint8_t kdns_bond_create(struct netdev_config *cfg) {
+    int ret;
+    uint8_t i;
+    int socket_id = rte_eth_dev_socket_id(cfg->port_ids[0]);
+
+    ret = rte_eth_bond_create(BOND_PORT_NAME, cfg->bond_mode, socket_id < 0 ? 0 : socket_id);
+    if (ret < 0) {
+        log_msg(LOG_ERR, "Could not create bond port, mode(%s) ret(%d)\n", netdev_bond_mode_str(cfg->bond_mode), ret);
+        exit(-1);
+    }
+    uint8_t bond_id = (uint8_t)ret;
+
+    for (i = 0; i < cfg->port_num; i++) {
+        ret = rte_eth_bond_slave_add(bond_id, cfg->port_ids[i]);
+        if (ret < 0) {
+            log_msg(LOG_ERR, "Could not add port(%u) to bond port(%u) ret(%d)\n", cfg->port_ids[i], bond_id, ret);
+            exit(-1);
+        }
+    }
+    /* spread the flows of the clients over the slaves */
+    if (cfg->bond_mode == BONDING_MODE_8023AD || cfg->bond_mode == BONDING_MODE_BALANCE) {
+        rte_eth_bond_xmit_policy_set(bond_id, BALANCE_XMIT_POLICY_LAYER34);
+    }
+    log_msg(LOG_INFO, "Bond port(%u) created, mode(%s) slaves(%u)\n", bond_id, netdev_bond_mode_str(cfg->bond_mode), cfg->port_num);
+    return bond_id;
+}
+
+/* offload the checksums of the responses when the port can, the tx queues then leave the simple path */
+static void netif_tx_offload_init(uint8_t port_id, struct rte_eth_txconf *txconf) {
+    uint64_t ol_flags = 0;
+    struct rte_eth_dev_info dev_info;
+
+    memset(&dev_info, 0, sizeof(dev_info));
+    rte_eth_dev_info_get(port_id, &dev_info);
+    *txconf = dev_info.default_txconf;
+
+    if (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_IPV4_CKSUM) {
+        ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+        if (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_UDP_CKSUM) {
+            ol_flags |= PKT_TX_UDP_CKSUM;
+        }
+        txconf->txq_flags &= ~ETH_TXQ_FLAGS_NOXSUMUDP;
+    }
+    kdns_net_device.tx_ol_flags[port_id] = ol_flags;
+    log_msg(LOG_INFO, "port(%u) tx checksum offload: ip %s, udp %s\n", port_id,
+            (ol_flags & PKT_TX_IP_CKSUM) ? "yes" : "no", (ol_flags & PKT_TX_UDP_CKSUM) ? "yes" : "no");
+}
+
+static void check_port_rx_ptypes(uint8_t port_id) {
+    int i, num;
+    uint32_t ptypes[32];
+
+    num = rte_eth_dev_get_supported_ptypes(port_id, RTE_PTYPE_L4_MASK, ptypes, RTE_DIM(ptypes));
+    for (i = 0; i < num && i < (int)RTE_DIM(ptypes); i++) {
+        if (ptypes[i] == RTE_PTYPE_L4_UDP) {
+            log_msg(LOG_INFO, "port(%u) rx packet type: udp classified\n", port_id);
+            return;
+        }
+    }
+    log_msg(LOG_INFO, "port(%u) rx packet type: not classified, parsed in software\n", port_id);
+}
+
+static int netif_reta_update(uint8_t port_id, const uint16_t *reta, uint16_t reta_size) {
+    uint16_t i;
+    struct rte_eth_rss_reta_entry64 reta_conf[NETIF_RETA_MAX / RTE_RETA_GROUP_SIZE];
+
+    memset(reta_conf, 0, sizeof(reta_conf));
+    for (i = 0; i < reta_size; i++) {
+        reta_conf[i / RTE_RETA_GROUP_SIZE].mask |= 1ULL << (i % RTE_RETA_GROUP_SIZE);
+        reta_conf[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE] = reta[i];
+    }
+    return rte_eth_dev_rss_reta_update(port_id, reta_conf, reta_size);
+}
+
+/* spread rss over the data queues only, required with kni-queue and optional for rebalancing */
+static void netif_reta_init(uint8_t idx, uint16_t nb_queues, int required) {
+    int ret;
+    uint16_t i;
+    struct rte_eth_dev_info dev_info;
+    uint8_t port_id = kdns_net_device.port_ids[idx];
+    uint16_t *reta = kdns_net_device.reta[idx];
+
+    memset(&dev_info, 0, sizeof(dev_info));
+    rte_eth_dev_info_get(port_id, &dev_info);
+    if (dev_info.reta_size == 0 || dev_info.reta_size > NETIF_RETA_MAX || !rte_is_power_of_2(dev_info.reta_size)) {
+        log_msg(LOG_ERR, "port(%u) reta size %u not supported\n", port_id, dev_info.reta_size);
+        if (required) {
+            exit(-1);
+        }
+        return;
+    }
+
+    for (i = 0; i < dev_info.reta_size; i++) {
+        reta[i] = i % nb_queues;
+    }
+    ret = netif_reta_update(port_id, reta, dev_info.reta_size);
+    if (ret < 0) {
+        log_msg(LOG_ERR, "Could not update reta of port(%u) ret(%d)\n", port_id, ret);
+        if (required) {
+            exit(-1);
+        }
+        return;
+    }
+    kdns_net_device.reta_size[idx] = dev_info.reta_size;
+}
+
+struct reta_bucket {
+    uint32_t hits;
+    uint16_t bucket;
+};
+
+static int reta_bucket_cmp(const void *a, const void *b) {
+    const struct reta_bucket *ba = a, *bb = b;
+    return ba->hits < bb->hits ? 1 : (ba->hits > bb->hits ? -1 : 0);
+}
+
+/* the busiest queue above the threshold gives its hottest bucket that still fits to the least loaded one, the rest stay put */
+static void netif_reta_rebalance_port(uint8_t idx, uint16_t nb_queues) {
+    uint16_t b, q, min_q, max_q, moves;
+    uint32_t cur;
+    unsigned lcore_id;
+    uint64_t total = 0, old_max = 0, new_max = 0;
+    uint64_t old_load[RTE_MAX_LCORE] = {0}, new_load[RTE_MAX_LCORE] = {0};
+    uint16_t new_reta[NETIF_RETA_MAX];
+    struct reta_bucket buckets[NETIF_RETA_MAX];
+
+    uint8_t port_id = kdns_net_device.port_ids[idx];
+    uint16_t reta_size = kdns_net_device.reta_size[idx];
+    uint16_t *reta = kdns_net_device.reta[idx];
+    uint32_t *prev = kdns_net_device.reta_prev_hits[idx];
+
+    for (b = 0; b < reta_size; b++) {
+        cur = 0;
+        RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+            struct netif_queue_conf *conf = &kdns_net_device.l_netif_queue_conf[lcore_id];
+            if (conf->reta_hits) {
+                cur += conf->reta_hits[idx * NETIF_RETA_MAX + b];
+            }
+        }
+        buckets[b].hits = cur - prev[b];
+        buckets[b].bucket = b;
+        prev[b] = cur;
+        old_load[reta[b]] += buckets[b].hits;
+        total += buckets[b].hits;
+    }
+    for (q = 0; q < nb_queues; q++) {
+        old_max = RTE_MAX(old_max, old_load[q]);
+    }
+    /* leave it alone unless the hottest queue is 25% above the mean */
+    if (total < RETA_REBALANCE_MIN_HITS || old_max * nb_queues * 4 <= total * 5) {
+        return;
+    }
+
+    qsort(buckets, reta_size, sizeof(struct reta_bucket), reta_bucket_cmp);
+    memcpy(new_reta, reta, reta_size * sizeof(uint16_t));
+    memcpy(new_load, old_load, nb_queues * sizeof(uint64_t));
+    for (moves = 0; moves < RETA_REBALANCE_MAX_MOVES; moves++) {
+        min_q = max_q = 0;
+        for (q = 1; q < nb_queues; q++) {
+            if (new_load[q] < new_load[min_q]) {
+                min_q = q;
+            }
+            if (new_load[q] > new_load[max_q]) {
+                max_q = q;
+            }
+        }
+        if (new_load[max_q] * nb_queues * 4 <= total * 5) {
+            break;
+        }
+        /* a move must not leave the target hotter than the source was */
+        for (b = 0; b < reta_size && buckets[b].hits > 0; b++) {
+            if (new_reta[buckets[b].bucket] == max_q && new_load[min_q] + buckets[b].hits < new_load[max_q]) {
+                break;
+            }
+        }
+        if (b == reta_size || buckets[b].hits == 0) {
+            break;
+        }
+        new_reta[buckets[b].bucket] = min_q;
+        new_load[max_q] -= buckets[b].hits;
+        new_load[min_q] += buckets[b].hits;
+    }
+    for (q = 0; q < nb_queues; q++) {
+        new_max = RTE_MAX(new_max, new_load[q]);
+    }
+    if (moves == 0 || new_max >= old_max) {
+        return;
+    }
+
+    if (netif_reta_update(port_id, new_reta, reta_size) < 0) {
+        log_msg(LOG_ERR, "Could not rebalance reta of port(%u)\n", port_id);
+        return;
+    }
+    memcpy(reta, new_reta, reta_size * sizeof(uint16_t));
+    log_msg(LOG_INFO, "port(%u) reta rebalanced, %u buckets moved, hottest queue %lu -> %lu of %lu pkts\n", port_id, moves, old_max, new_max, total);
+}
+
+/* called by master every reta-interval seconds */
+void netif_reta_rebalance(void) {
+    uint8_t i;
+
+    for (i = 0; i < kdns_net_device.port_num; i++) {
+        if (kdns_net_device.reta_size[i] > 0) {
+            netif_reta_rebalance_port(i, g_dns_cfg->netdev.rxq_num);
+        }
+    }
+}
+
+static struct rte_flow *netif_flow_create(uint8_t port_id, uint32_t priority, const struct rte_flow_item *pattern,
+        const struct rte_flow_action *actions, const char *name) {
+    struct rte_flow_error error;
+    struct rte_flow_attr attr = {.priority = priority, .ingress = 1};
+    struct rte_flow *flow = NULL;
+
+    memset(&error, 0, sizeof(error));
+    if (rte_flow_validate(port_id, &attr, pattern, actions, &error) != 0 ||
+        (flow = rte_flow_create(port_id, &attr, pattern, actions, &error)) == NULL) {
+        log_msg(LOG_ERR, "port(%u) could not steer %s: %s\n", port_id, name, error.message ? error.message : "unknown");
+        return NULL;
+    }
+    log_msg(LOG_INFO, "port(%u) steers %s\n", port_id, name);
+    return flow;
+}
+
+static int netif_flow_to_queue(uint8_t port_id, const struct rte_flow_item *pattern, uint16_t queue_id, const char *name) {
+    struct rte_flow_action_queue queue = {.index = queue_id};
+    struct rte_flow_action actions[] = {
+        {.type = RTE_FLOW_ACTION_TYPE_QUEUE, .conf = &queue},
+        {.type = RTE_FLOW_ACTION_TYPE_END},
+    };
+    char desc[64];
+
+    snprintf(desc, sizeof(desc), "%s to queue %u", name, queue_id);
+    return netif_flow_create(port_id, 0, pattern, actions, desc) ? 0 : -1;
+}
+
+/* udp to port 53 is spread over the data queues and all else goes to the kni queue */
+static int netif_kni_dns_flows_create(uint8_t port_id, uint16_t queue_id) {
+    struct rte_flow_error error;
+    struct rte_eth_rss_conf rss_conf;
+    struct rte_flow *dns_flow, *kni_flow;
+    uint16_t q, nb_data_q = g_dns_cfg->netdev.rxq_num;
+    struct {
+        struct rte_flow_action_rss rss;
+        uint16_t queue[RTE_MAX_QUEUES_PER_PORT];
+    } rss_action;
+
+    memset(&rss_conf, 0, sizeof(rss_conf));
+    if (rte_eth_dev_rss_hash_conf_get(port_id, &rss_conf) != 0) {
+        return -1;
+    }
+    rss_conf.rss_key = NULL;
+    memset(&rss_action, 0, sizeof(rss_action));
+    rss_action.rss.rss_conf = &rss_conf;
+    rss_action.rss.num = nb_data_q;
+    for (q = 0; q < nb_data_q; q++) {
+        rss_action.rss.queue[q] = q;
+    }
+
+    struct rte_flow_item_udp udp_spec;
+    struct rte_flow_item_udp udp_mask;
+    struct rte_flow_item dns[] = {
+        {.type = RTE_FLOW_ITEM_TYPE_ETH},
+        {.type = RTE_FLOW_ITEM_TYPE_IPV4},
+        {.type = RTE_FLOW_ITEM_TYPE_UDP, .spec = &udp_spec, .mask = &udp_mask},
+        {.type = RTE_FLOW_ITEM_TYPE_END},
+    };
+    memset(&udp_spec, 0, sizeof(udp_spec));
+    memset(&udp_mask, 0, sizeof(udp_mask));
+    udp_spec.hdr.dst_port = rte_cpu_to_be_16(53);
+    udp_mask.hdr.dst_port = 0xffff;
+    struct rte_flow_action dns_actions[] = {
+        {.type = RTE_FLOW_ACTION_TYPE_RSS, .conf = &rss_action.rss},
+        {.type = RTE_FLOW_ACTION_TYPE_END},
+    };
+    dns_flow = netif_flow_create(port_id, 0, dns, dns_actions, "udp port 53 to the data queues");
+    if (dns_flow == NULL) {
+        return -1;
+    }
+
+    struct rte_flow_item all[] = {
+        {.type = RTE_FLOW_ITEM_TYPE_ETH},
+        {.type = RTE_FLOW_ITEM_TYPE_END},
+    };
+    struct rte_flow_action_queue queue = {.index = queue_id};
+    struct rte_flow_action kni_actions[] = {
+        {.type = RTE_FLOW_ACTION_TYPE_QUEUE, .conf = &queue},
+        {.type = RTE_FLOW_ACTION_TYPE_END},
+    };
+    kni_flow = netif_flow_create(port_id, 1, all, kni_actions, "the rest to the kni queue");
+    if (kni_flow == NULL) {
+        rte_flow_destroy(port_id, dns_flow, &error);
+        return -1;
+    }
+    return 0;
+}
+
+/* prefer the dns split, else arp, icmp and tcp go to the kni queue and what a rule misses is still handed over by the slaves */
+static void netif_kni_flows_create(uint8_t port_id, uint16_t queue_id) {
+    if (netif_kni_dns_flows_create(port_id, queue_id) == 0) {
+        return;
+    }
+    log_msg(LOG_INFO, "port(%u) falls back to the arp, icmp and tcp kni rules\n", port_id);
+
+    struct rte_flow_item_eth eth_spec = {.type = rte_cpu_to_be_16(ETHER_TYPE_ARP)};
+    struct rte_flow_item_eth eth_mask = {.type = 0xffff};
+    struct rte_flow_item arp[] = {
+        {.type = RTE_FLOW_ITEM_TYPE_ETH, .spec = &eth_spec, .mask = &eth_mask},
+        {.type = RTE_FLOW_ITEM_TYPE_END},
+    };
+    netif_flow_to_queue(port_id, arp, queue_id, "arp");
+
+    struct rte_flow_item_ipv4 ip_spec;
+    struct rte_flow_item_ipv4 ip_mask;
+    struct rte_flow_item ip[] = {
+        {.type = RTE_FLOW_ITEM_TYPE_ETH},
+        {.type = RTE_FLOW_ITEM_TYPE_IPV4, .spec = &ip_spec, .mask = &ip_mask},
+        {.type = RTE_FLOW_ITEM_TYPE_END},
+    };
+    memset(&ip_spec, 0, sizeof(ip_spec));
+    memset(&ip_mask, 0, sizeof(ip_mask));
+    ip_mask.hdr.next_proto_id = 0xff;
+
+    ip_spec.hdr.next_proto_id = IPPROTO_ICMP;
+    netif_flow_to_queue(port_id, ip, queue_id, "icmp");
+    ip_spec.hdr.next_proto_id = IPPROTO_TCP;
+    netif_flow_to_queue(port_id, ip, queue_id, "tcp");
+}
+
+/* hash the udp ports too when asked and the port can, the clients behind a nat then spread over the queues */
+static void netif_rss_hf_init(uint8_t port_id, struct rte_eth_conf *conf) {
+    struct rte_eth_dev_info dev_info;
+    uint64_t rss_hf = ETH_RSS_IP;
+
+    if (g_dns_cfg->netdev.rss_udp) {
+        memset(&dev_info, 0, sizeof(dev_info));
+        rte_eth_dev_info_get(port_id, &dev_info);
+        if (dev_info.flow_type_rss_offloads & ETH_RSS_NONFRAG_IPV4_UDP) {
+            rss_hf |= ETH_RSS_NONFRAG_IPV4_UDP;
+        } else {
+            log_msg(LOG_ERR, "port(%u) cannot hash udp ports, ip only\n", port_id);
+        }
+    }
+    conf->rx_adv_conf.rss_conf.rss_hf = rss_hf;
+}
+
+static void kdns_port_init(uint8_t idx) {
+    uint8_t port_id = kdns_net_device.port_ids[idx];
     int ret;
     uint16_t q;
+    int socket_id;
     struct rte_eth_conf conf;
+    struct rte_eth_txconf txconf;
 
     int mode = g_dns_cfg->netdev.mode;
-    uint16_t nb_rx_q = g_dns_cfg->netdev.rxq_num;
+    uint16_t nb_rx_q = g_dns_cfg->netdev.rxq_num + kdns_net_device.kni_queue;
     uint16_t nb_tx_q = g_dns_cfg->netdev.txq_num;
     uint16_t nb_rx_desc = g_dns_cfg->netdev.rxq_desc_num;
     uint16_t nb_tx_desc = g_dns_cfg->netdev.txq_desc_num;
-    unsigned nb_mbuf = g_dns_cfg->netdev.mbuf_num;
 
-    pkt_mbuf_pool = rte_pktmbuf_pool_create("pkt_mbuf_pool", nb_mbuf, MBUF_CACHE_DEF, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_eth_dev_socket_id(port_id));
-    if (pkt_mbuf_pool == NULL) {
-        log_msg(LOG_ERR, "Could not initialise pkt_mbuf_pool\n");
-        exit(-1);
-    }
     log_msg(LOG_INFO, "Initialising port(%u), rx queues(%u) desc(%u), tx queues(%u) desc(%u) ...\n", port_id, nb_rx_q, nb_rx_desc, nb_tx_q, nb_tx_desc);
 
     if (mode == 0) {
         memcpy(&conf, &port_conf_rss, sizeof(conf));
+        netif_rss_hf_init(port_id, &conf);
     } else {
         memcpy(&conf, &port_conf, sizeof(conf));
     }
@@ -253,20 +837,22 @@ static void kdns_port_init(uint8_t port_id) {
         exit(-1);
     }
     for (q = 0; q < nb_rx_q; ++q) {
-        ret = rte_eth_rx_queue_setup(port_id, q, nb_rx_desc, rte_eth_dev_socket_id(port_id), NULL, pkt_mbuf_pool);
+        socket_id = netif_queue_socket_id(port_id, q, 0);
+        ret = rte_eth_rx_queue_setup(port_id, q, nb_rx_desc, socket_id, NULL, netif_pktmbuf_pool_get(socket_id));
         if (ret < 0) {
             log_msg(LOG_ERR, "Could not setup up RX queue for port(%u) queue(%u) ret(%d)\n", port_id, q, ret);
             exit(-1);
         }
     }
+    netif_tx_offload_init(port_id, &txconf);
     for (q = 0; q < nb_tx_q; ++q) {
-        ret = rte_eth_tx_queue_setup(port_id, q, nb_tx_desc, rte_eth_dev_socket_id(port_id), NULL);
+        ret = rte_eth_tx_queue_setup(port_id, q, nb_tx_desc, netif_queue_socket_id(port_id, q, 1), &txconf);
         if (ret < 0) {
             log_msg(LOG_ERR, "Could not setup up X queue for port(%u) queue(%u) ret(%d)\n", port_id, q, ret);
             exit(-1);
         }
     }
-    netif_queue_core_bind(port_id);
+    netif_queue_stats_mapping(port_id, nb_rx_q, nb_tx_q);
 
     ret = rte_eth_dev_start(port_id);
     if (ret < 0) {
@@ -274,6 +860,13 @@ static void kdns_port_init(uint8_t port_id) {
         exit(-1);
     }
     rte_eth_promiscuous_enable(port_id);
+
+    if (mode == 0 && (kdns_net_device.kni_queue || g_dns_cfg->netdev.reta_interval)) {
+        netif_reta_init(idx, g_dns_cfg->netdev.rxq_num, kdns_net_device.kni_queue);
+    }
+    if (kdns_net_device.kni_queue) {
+        netif_kni_flows_create(port_id, kdns_net_device.kni_queue_id);
+    }
 }
 
 static int kni_config_network_interface(uint8_t port_id, uint8_t if_up) {
@@ -355,57 +948,70 @@ static int kni_change_mtu(uint8_t port_id, unsigned new_mtu) {
     return 0;
 }
 
-__attribute__((unused)) static int kdns_kni_deinit(uint8_t port_id) {
-    if (rte_kni_release(kdns_kni)) {
+__attribute__((unused)) static int kdns_kni_deinit(uint8_t idx) {
+    uint8_t port_id = kdns_net_device.port_ids[idx];
+
+    if (rte_kni_release(kdns_net_device.knis[idx])) {
         log_msg(LOG_ERR, "Fail to release kni\n");
     }
     rte_eth_dev_stop(port_id);
     return 0;
 }
 
-static int kdns_kni_init(uint8_t port_id) {
-    struct rte_kni_ops ops;
-    struct rte_kni_conf conf;
-    struct rte_eth_dev_info dev_info;
-
-    unsigned nb_mbuf = g_dns_cfg->netdev.kni_mbuf_num;
-    char *kni_name = g_dns_cfg->netdev.kni_name_prefix;
+/* the kni is served by master, so is its pool */
+static void kni_mbuf_pool_init(int socket_id) {
+    unsigned nb_kni_mbuf = g_dns_cfg->netdev.kni_mbuf_num;
 
-    kni_mbuf_pool = rte_pktmbuf_pool_create("kni_mbuf_pool", nb_mbuf, MBUF_CACHE_DEF, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_eth_dev_socket_id(port_id));
+    kni_mbuf_pool = rte_pktmbuf_pool_create("kni_mbuf_pool", nb_kni_mbuf, MBUF_CACHE_DEF, 0, RTE_MBUF_DEFAULT_BUF_SIZE, socket_id);
     if (kni_mbuf_pool == NULL) {
         log_msg(LOG_ERR, "Could not initialise kni_mbuf_pool\n");
         exit(-1);
     }
+}
 
-    rte_kni_init(1);
+/* the kni keeps name-prefix when there is one port, else it is suffixed by the index */
+static int kdns_kni_init(uint8_t idx) {
+    struct rte_kni_ops ops;
+    struct rte_kni_conf conf;
+    struct rte_eth_dev_info dev_info;
+    struct ether_addr hwaddr;
+
+    uint8_t port_id = kdns_net_device.port_ids[idx];
+    char *kni_name = g_dns_cfg->netdev.kni_name_prefix;
 
     memset(&conf, 0, sizeof(conf));
     conf.core_id = 0;
     conf.force_bind = 1;
     conf.group_id = (uint16_t)port_id;
     conf.mbuf_size = RTE_MBUF_DEFAULT_DATAROOM;
-    snprintf(conf.name, sizeof(conf.name), "%s", kni_name);
+    if (kdns_net_device.port_num == 1) {
+        snprintf(conf.name, sizeof(conf.name), "%s", kni_name);
+    } else {
+        snprintf(conf.name, sizeof(conf.name), "%s%u", kni_name, idx);
+    }
 
     memset(&dev_info, 0, sizeof(dev_info));
     rte_eth_dev_info_get(port_id, &dev_info);
-    conf.addr = dev_info.pci_dev->addr;
-    conf.id = dev_info.pci_dev->id;
+    if (dev_info.pci_dev) {     //a bond port has no pci device
+        conf.addr = dev_info.pci_dev->addr;
+        conf.id = dev_info.pci_dev->id;
+    }
 
     memset(&ops, 0, sizeof(ops));
     ops.port_id = port_id;
     ops.change_mtu = kni_change_mtu;
     ops.config_network_if = kni_config_network_interface;
 
-    kdns_kni = rte_kni_alloc(kni_mbuf_pool, &conf, &ops);
-    if (!kdns_kni) {
+    kdns_net_device.knis[idx] = rte_kni_alloc(kni_mbuf_pool, &conf, &ops);
+    if (!kdns_net_device.knis[idx]) {
         log_msg(LOG_ERR, "Fail to create kni for port: %d\n", port_id);
         exit(-1);
     }
 
-    rte_eth_macaddr_get(port_id, &kdns_net_device.hwaddr);
-    if (linux_set_if_mac(conf.name, (unsigned char *)&kdns_net_device.hwaddr) != 0) {
+    rte_eth_macaddr_get(port_id, &hwaddr);
+    if (linux_set_if_mac(conf.name, (unsigned char *)&hwaddr) != 0) {
         char str_mac[ETHER_ADDR_FMT_SIZE];
-        ether_format_addr(str_mac, ETHER_ADDR_FMT_SIZE, &kdns_net_device.hwaddr);
+        ether_format_addr(str_mac, ETHER_ADDR_FMT_SIZE, &hwaddr);
         log_msg(LOG_ERR, "Fail to set mac %s for %s: %s\n", str_mac, conf.name, strerror(errno));
         exit(-1);
     }
@@ -413,39 +1019,236 @@ static int kdns_kni_init(uint8_t port_id) {
 }
 
 int kdns_netdev_init(void) {
+    uint8_t i, port_id;
+    uint64_t port_mask = 0;
+    struct netdev_config *cfg = &g_dns_cfg->netdev;
+
     uint8_t nb_sys_ports = rte_eth_dev_count();
     if (nb_sys_ports == 0) {
         log_msg(LOG_ERR, "No supported Ethernet device found\n");
         exit(-1);
     }
-    if (nb_sys_ports != 1) {
-        log_msg(LOG_ERR, "Now just one port supported\n");
-        exit(-1);
+    for (i = 0; i < cfg->port_num; i++) {
+        if (cfg->port_ids[i] >= nb_sys_ports) {
+            log_msg(LOG_ERR, "Port %u not found, %u ports available\n", cfg->port_ids[i], nb_sys_ports);
+            exit(-1);
+        }
+    }
+
+    if (cfg->rx_lcores > 0) {
+        unsigned nb_slaves = rte_lcore_count() - 1;
+        if (cfg->rx_lcores > NETIF_MAX_RX_LCORES || cfg->rx_lcores >= nb_slaves) {
+            log_msg(LOG_ERR, "rx-lcores %u must be below the %u slave lcores and at most %u\n", cfg->rx_lcores, nb_slaves, NETIF_MAX_RX_LCORES);
+            exit(-1);
+        }
+        if (cfg->rxq_num != cfg->rx_lcores || cfg->txq_num < nb_slaves - cfg->rx_lcores) {
+            log_msg(LOG_ERR, "rx-lcores %u needs rxqueue-num %u and txqueue-num >= %u\n", cfg->rx_lcores, cfg->rx_lcores, nb_slaves - cfg->rx_lcores);
+            exit(-1);
+        }
     }
 
-    uint8_t port_id = 0;
-    kdns_port_init(port_id);
-    kdns_kni_init(port_id);
-    check_all_ports_link_status(nb_sys_ports, 1);
-    check_port_flow_type_rss_offloads(port_id);
+    kni_mbuf_pool_init(rte_lcore_to_socket_id(rte_get_master_lcore()));
+
+    if (cfg->bond_mode >= 0) {
+        kdns_net_device.port_ids[0] = kdns_bond_create(cfg);
+        kdns_net_device.port_num = 1;
+    } else {
+        memcpy(kdns_net_device.port_ids, cfg->port_ids, cfg->port_num);
+        kdns_net_device.port_num = cfg->port_num;
+    }
+
+    /* bound first, the queues are set up on the socket of their lcore */
+    netif_queue_core_bind();
+    netif_queue_rings_init();
+    kdns_net_device.kni_queue = cfg->kni_queue ? 1 : 0;
+    kdns_net_device.kni_queue_id = cfg->rxq_num;
+
+    rte_kni_init(kdns_net_device.port_num);
+    for (i = 0; i < kdns_net_device.port_num; i++) {
+        port_id = kdns_net_device.port_ids[i];
+        if (port_id >= 64) {    //a bond port may be above the configured ones
+            log_msg(LOG_ERR, "Port %u is above the 64 ports of the link check mask\n", port_id);
+            exit(-1);
+        }
+        kdns_port_init(i);
+        kdns_kni_init(i);
+        port_mask |= 1ULL << port_id;
+    }
+    netif_reta_hits_init();
+    netif_frag_tbl_init();
+
+    check_all_ports_link_status(rte_eth_dev_count(), port_mask);
+    for (i = 0; i < kdns_net_device.port_num; i++) {
+        check_port_flow_type_rss_offloads(kdns_net_device.port_ids[i]);
+        check_port_rx_ptypes(kdns_net_device.port_ids[i]);
+    }
 
     return 0;
 }
 
+static struct rte_kni *netif_kni_get(uint8_t port_id) {
+    uint8_t i;
+    for (i = 0; i < kdns_net_device.port_num; i++) {
+        if (kdns_net_device.port_ids[i] == port_id) {
+            return kdns_net_device.knis[i];
+        }
+    }
+    return NULL;
+}
+
+/* each mbuf goes to the kni of the port it was received on */
 void kni_egress(struct rte_mbuf **mbufs, uint16_t nb_mbufs) {
-    uint16_t nb_tx = rte_kni_tx_burst(kdns_kni, mbufs, nb_mbufs);
-    if (unlikely(nb_tx < nb_mbufs)) {
-        log_msg(LOG_ERR, "Failed to send %u pkt to kni\n", nb_mbufs - nb_tx);
-        do {
-            rte_pktmbuf_free(mbufs[nb_tx]);
-        } while (++nb_tx < nb_mbufs);
+    uint16_t i, run, nb_tx;
+    struct rte_kni *kni;
+
+    for (i = 0; i < nb_mbufs; i += run) {
+        run = netif_port_run(mbufs + i, nb_mbufs - i);
+        kni = netif_kni_get(mbufs[i]->port);
+        nb_tx = kni ? rte_kni_tx_burst(kni, mbufs + i, run) : 0;
+        if (unlikely(nb_tx < run)) {
+            log_msg(LOG_ERR, "Failed to send %u pkt to kni of port %u\n", run - nb_tx, mbufs[i]->port);
+            do {
+                rte_pktmbuf_free(mbufs[i + nb_tx]);
+            } while (++nb_tx < run);
+        }
     }
 }
 
+/* the mbufs are tagged with the port of their kni */
 int kni_ingress(struct rte_mbuf **mbufs, uint16_t nb_mbufs) {
-    rte_kni_handle_request(kdns_kni);
+    uint8_t i;
+    uint16_t j, nb_rx, nb_all = 0;
 
-    return rte_kni_rx_burst(kdns_kni, mbufs, nb_mbufs);
+    for (i = 0; i < kdns_net_device.port_num; i++) {
+        rte_kni_handle_request(kdns_net_device.knis[i]);
+        if (nb_all == nb_mbufs) {
+            continue;
+        }
+        nb_rx = rte_kni_rx_burst(kdns_net_device.knis[i], mbufs + nb_all, nb_mbufs - nb_all);
+        for (j = nb_all; j < nb_all + nb_rx; j++) {
+            mbufs[j]->port = kdns_net_device.port_ids[i];
+        }
+        nb_all += nb_rx;
+    }
+    return nb_all;
+}
+
+/* master polls the kni queues and hands the mbufs to kni directly */
+int kni_queue_ingress(struct rte_mbuf **mbufs, uint16_t nb_mbufs) {
+    uint8_t i;
+    uint16_t j, nb_rx, nb_all = 0;
+
+    if (!kdns_net_device.kni_queue) {
+        return 0;
+    }
+    for (i = 0; i < kdns_net_device.port_num && nb_all < nb_mbufs; i++) {
+        nb_rx = rte_eth_rx_burst(kdns_net_device.port_ids[i], kdns_net_device.kni_queue_id, mbufs + nb_all, nb_mbufs - nb_all);
+        for (j = nb_all; j < nb_all + nb_rx; j++) {
+            mbufs[j]->port = kdns_net_device.port_ids[i];
+        }
+        nb_all += nb_rx;
+    }
+    return nb_all;
+}
+
+static inline int netif_local_addr(uint32_t addr) {
+    uint8_t i;
+
+    for (i = 0; i < g_dns_cfg->netdev.local_addr_num; i++) {
+        if (g_dns_cfg->netdev.local_addrs[i] == addr) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int netif_arp_reply(struct rte_mbuf *m, struct ether_hdr *eth_hdr, struct netif_queue_stats *stats) {
+    uint32_t addr;
+    struct ether_addr hwaddr;
+    struct arp_hdr *arp_hdr = (struct arp_hdr *)(eth_hdr + 1);
+
+    /* gratuitous arp is left to the kernel */
+    if (m->data_len < sizeof(struct ether_hdr) + sizeof(struct arp_hdr)
+            || arp_hdr->arp_hrd != rte_cpu_to_be_16(ARP_HRD_ETHER)
+            || arp_hdr->arp_pro != rte_cpu_to_be_16(ETHER_TYPE_IPv4)
+            || arp_hdr->arp_op != rte_cpu_to_be_16(ARP_OP_REQUEST)
+            || arp_hdr->arp_data.arp_sip == arp_hdr->arp_data.arp_tip
+            || !netif_local_addr(arp_hdr->arp_data.arp_tip)) {
+        return 0;
+    }
+
+    rte_eth_macaddr_get(m->port, &hwaddr);
+    arp_hdr->arp_op = rte_cpu_to_be_16(ARP_OP_REPLY);
+    ether_addr_copy(&arp_hdr->arp_data.arp_sha, &arp_hdr->arp_data.arp_tha);
+    ether_addr_copy(&hwaddr, &arp_hdr->arp_data.arp_sha);
+    addr = arp_hdr->arp_data.arp_sip;
+    arp_hdr->arp_data.arp_sip = arp_hdr->arp_data.arp_tip;
+    arp_hdr->arp_data.arp_tip = addr;
+
+    ether_addr_copy(&eth_hdr->s_addr, &eth_hdr->d_addr);
+    ether_addr_copy(&hwaddr, &eth_hdr->s_addr);
+    stats->pkts_arp++;
+    return 1;
+}
+
+static int netif_icmp_reply(struct rte_mbuf *m, struct ether_hdr *eth_hdr, struct netif_queue_stats *stats) {
+    uint32_t addr, cksum;
+    struct ether_addr tmp_mac;
+    struct ipv4_hdr *ipv4_hdr = (struct ipv4_hdr *)(eth_hdr + 1);
+    struct icmp_hdr *icmp_hdr = (struct icmp_hdr *)(ipv4_hdr + 1);
+
+    /* options and fragments are left to the kernel */
+    if (m->data_len < sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) + sizeof(struct icmp_hdr)
+            || ipv4_hdr->version_ihl != IP_VHL_DEF
+            || ipv4_hdr->next_proto_id != IPPROTO_ICMP
+            || rte_ipv4_frag_pkt_is_fragmented(ipv4_hdr)
+            || m->data_len < sizeof(struct ether_hdr) + rte_be_to_cpu_16(ipv4_hdr->total_length)
+            || icmp_hdr->icmp_type != IP_ICMP_ECHO_REQUEST
+            || icmp_hdr->icmp_code != 0
+            || !netif_local_addr(ipv4_hdr->dst_addr)) {
+        return 0;
+    }
+
+    ether_addr_copy(&eth_hdr->s_addr, &tmp_mac);
+    ether_addr_copy(&eth_hdr->d_addr, &eth_hdr->s_addr);
+    ether_addr_copy(&tmp_mac, &eth_hdr->d_addr);
+
+    /* a reply starts with a fresh ttl, so the ip checksum is redone */
+    addr = ipv4_hdr->src_addr;
+    ipv4_hdr->src_addr = ipv4_hdr->dst_addr;
+    ipv4_hdr->dst_addr = addr;
+    ipv4_hdr->time_to_live = IP_DEFTTL;
+    ipv4_hdr->hdr_checksum = 0;
+    ipv4_hdr->hdr_checksum = rte_ipv4_cksum(ipv4_hdr);
+
+    /* rfc 1624 incremental update for the type change */
+    icmp_hdr->icmp_type = IP_ICMP_ECHO_REPLY;
+    cksum = ~icmp_hdr->icmp_cksum & 0xffff;
+    cksum += ~rte_cpu_to_be_16(IP_ICMP_ECHO_REQUEST << 8) & 0xffff;
+    cksum += rte_cpu_to_be_16(IP_ICMP_ECHO_REPLY << 8);
+    cksum = (cksum & 0xffff) + (cksum >> 16);
+    cksum = (cksum & 0xffff) + (cksum >> 16);
+    icmp_hdr->icmp_cksum = ~cksum;
+    stats->pkts_icmp++;
+    return 1;
+}
+
+int netif_local_reply(struct rte_mbuf *m, struct netif_queue_stats *stats) {
+    int ret = 0;
+    struct ether_hdr *eth_hdr = rte_pktmbuf_mtod(m, struct ether_hdr *);
+
+    if (g_dns_cfg->netdev.local_addr_num == 0) {
+        return 0;
+    }
+    if (eth_hdr->ether_type == rte_cpu_to_be_16(ETHER_TYPE_ARP)) {
+        ret = netif_arp_reply(m, eth_hdr, stats);
+    } else if (eth_hdr->ether_type == rte_cpu_to_be_16(ETHER_TYPE_IPv4)) {
+        ret = netif_icmp_reply(m, eth_hdr, stats);
+    }
+    if (ret) {
+        m->ol_flags = 0;
+    }
+    return ret;
 }
 
 void netif_statsdata_get(struct netif_queue_stats *sta) {
@@ -456,12 +1259,15 @@ void netif_statsdata_get(struct netif_queue_stats *sta) {
         sta->pkts_rcv += sta_lcore->pkts_rcv;
         sta->pkts_2kni += sta_lcore->pkts_2kni;
         sta->pkts_icmp += sta_lcore->pkts_icmp;
+        sta->pkts_arp += sta_lcore->pkts_arp;
         sta->dns_pkts_rcv += sta_lcore->dns_pkts_rcv;
         sta->dns_pkts_snd += sta_lcore->dns_pkts_snd;
         sta->dns_lens_rcv += sta_lcore->dns_lens_rcv;
         sta->dns_lens_snd += sta_lcore->dns_lens_snd;
         sta->pkt_dropped += sta_lcore->pkt_dropped;
         sta->pkt_len_err += sta_lcore->pkt_len_err;
+        sta->pkts_frag += sta_lcore->pkts_frag;
+        sta->frag_dropped += sta_lcore->frag_dropped;
 
 #ifdef ENABLE_KDNS_METRICS
         sta->metrics.timeSum +=  sta_lcore->metrics.timeSum;
@@ -477,6 +1283,10 @@ void netif_statsdata_get(struct netif_queue_stats *sta) {
         }
 #endif
     }
+    /* master answers those arriving on the kni queue */
+    sta_lcore = &kdns_net_device.l_netif_queue_conf[rte_get_master_lcore()].stats;
+    sta->pkts_icmp += sta_lcore->pkts_icmp;
+    sta->pkts_arp += sta_lcore->pkts_arp;
     return;
 }
 
@@ -488,13 +1298,19 @@ void netif_statsdata_reset(void) {
         sta_lcore->pkts_rcv = 0;
         sta_lcore->pkts_2kni = 0;
         sta_lcore->pkts_icmp = 0;
+        sta_lcore->pkts_arp = 0;
         sta_lcore->dns_pkts_rcv = 0;
         sta_lcore->dns_pkts_snd = 0;
         sta_lcore->dns_lens_rcv = 0;
         sta_lcore->dns_lens_snd = 0;
         sta_lcore->pkt_dropped = 0;
         sta_lcore->pkt_len_err = 0;
+        sta_lcore->pkts_frag = 0;
+        sta_lcore->frag_dropped = 0;
     }
+    sta_lcore = &kdns_net_device.l_netif_queue_conf[rte_get_master_lcore()].stats;
+    sta_lcore->pkts_icmp = 0;
+    sta_lcore->pkts_arp = 0;
     return;
 }
 
@@ -509,7 +1325,8 @@ void netif_statsdata_metrics_reset(void) {
     return;
 }
 
-void init_dns_packet_header(struct ether_hdr *eth_hdr, struct ipv4_hdr *ipv4_hdr, struct udp_hdr *udp_hdr, uint16_t data_len) {
+void init_dns_packet_header(struct rte_mbuf *pkt, struct ether_hdr *eth_hdr, struct ipv4_hdr *ipv4_hdr, struct udp_hdr *udp_hdr, uint16_t data_len) {
+    uint64_t ol_flags = kdns_net_device.tx_ol_flags[pkt->port];
     uint16_t udp_data_len = sizeof(struct udp_hdr) + data_len;
     uint16_t ipv4_data_len = sizeof(struct ipv4_hdr) + udp_data_len;
     /*
@@ -538,10 +1355,12 @@ void init_dns_packet_header(struct ether_hdr *eth_hdr, struct ipv4_hdr *ipv4_hdr
     ipv4_hdr->dst_addr = src_addr;
 
     /*
-     * Compute IP header checksum.
+     * Compute IP header checksum, or leave it to the nic.
      */
     ipv4_hdr->hdr_checksum = 0;
-    ipv4_hdr->hdr_checksum = rte_ipv4_cksum(ipv4_hdr);
+    if (!(ol_flags & PKT_TX_IP_CKSUM)) {
+        ipv4_hdr->hdr_checksum = rte_ipv4_cksum(ipv4_hdr);
+    }
 
     /*
      * Initialize UDP header.
@@ -552,5 +1371,12 @@ void init_dns_packet_header(struct ether_hdr *eth_hdr, struct ipv4_hdr *ipv4_hdr
     udp_hdr->src_port = dst_port;
     udp_hdr->dst_port = src_port;
     udp_hdr->dgram_len = rte_cpu_to_be_16(udp_data_len);
-    udp_hdr->dgram_cksum = 0;   /* No UDP checksum. */
+    udp_hdr->dgram_cksum = 0;   /* No UDP checksum in software. */
+
+    pkt->ol_flags = ol_flags;
+    pkt->l2_len = sizeof(struct ether_hdr);
+    pkt->l3_len = sizeof(struct ipv4_hdr);
+    if (ol_flags & PKT_TX_UDP_CKSUM) {
+        udp_hdr->dgram_cksum = rte_ipv4_phdr_cksum(ipv4_hdr, ol_flags);
+    }
 }
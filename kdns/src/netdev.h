@@ -6,19 +6,40 @@
 #include <rte_mempool.h>
 #include <rte_udp.h>
 #include <rte_ip.h>
+#include <rte_ethdev.h>
+#include <rte_ip_frag.h>
 #include "metrics.h"
 
 #define NETIF_MAX_PKT_BURST     (32)
+#define NETDEV_MAX_PORTS        (4)
+#define NETDEV_MAX_LOCAL_ADDRS  (8)
+#define NETIF_RING_SIZE         (4096)
+#define NETIF_MAX_RX_LCORES     (4)
+#define NETIF_QUEUE_NONE        (0xffff)
+#define NETIF_RETA_MAX          (ETH_RSS_RETA_SIZE_512)
+
+/* roles of the slave lcores, rx and worker only in distributor mode */
+enum {
+    NETIF_ROLE_RXTX = 0,
+    NETIF_ROLE_RX,
+    NETIF_ROLE_WORKER,
+};
+
+struct rte_kni;
+struct rte_ring;
 
 struct netif_queue_stats {
     uint64_t pkts_rcv;          /* Total number of receive packets */
     uint64_t pkts_2kni;         /* Total number of receive pkts to kni */
-    uint64_t pkts_icmp;         /* Total number of receive pkts to kni */
+    uint64_t pkts_icmp;         /* Total number of icmp echo answered */
+    uint64_t pkts_arp;          /* Total number of arp requests answered */
 
     uint64_t dns_pkts_rcv;      /* Total number of successfully received packets. */
     uint64_t dns_pkts_snd;      /* Total number of successfully transmitted packets. */
     uint64_t pkt_dropped;       /* Total number of dropped packets by software. */
     uint64_t pkt_len_err;       /* pkt len err. */
+    uint64_t pkts_frag;         /* Total number of receive ipv4 fragments */
+    uint64_t frag_dropped;      /* fragments timed out, over the table or too large */
 
     uint64_t dns_lens_rcv;      /* Total lens of  received packets. */
     uint64_t dns_lens_snd;      /* Total lens of  transmitted packets. */
@@ -36,17 +57,32 @@ struct netif_queue_stats {
     metrics_metrics_st metrics;
 } __rte_cache_aligned;
 
-/* RX/TX queue conf for lcore */
+/* RX/TX queue conf for lcore, the lcore polls the same queue on each port */
 struct netif_queue_conf {
-    uint16_t port_id;
+    uint8_t port_num;
+    uint8_t port_ids[NETDEV_MAX_PORTS];
     uint16_t rx_queue_id;
     uint16_t tx_queue_id;
+    struct rte_ring *kni_ring;  /* non-dns mbufs to master */
+    struct rte_ring *tx_ring;   /* kni and forward mbufs from master */
+
+    uint8_t role;
+    uint16_t role_idx;          /* index among the lcores of the same role */
+    struct rte_ring *dist_rings[NETIF_MAX_RX_LCORES];   /* of a worker, one from each rx lcore */
+
+    /* rx hits per reta bucket of each port, NULL when reta-interval is off */
+    uint32_t *reta_hits;
+    uint16_t reta_mask[NETDEV_MAX_PORTS];
     struct netif_queue_stats stats;
     uint16_t tx_len;
     struct rte_mbuf *tx_mbufs[NETIF_MAX_PKT_BURST];
 
     uint16_t kni_len;
     struct rte_mbuf *kni_mbufs[NETIF_MAX_PKT_BURST];
+
+    /* ipv4 reassembly of the lcores answering queries, NULL when frag-flows is 0 */
+    struct rte_ip_frag_tbl *frag_tbl;
+    struct rte_ip_frag_death_row frag_dr;
 } __rte_cache_aligned;
 
 struct net_device {
@@ -54,13 +90,62 @@ struct net_device {
     uint16_t max_tx_queues;
     uint16_t max_rx_desc;
     uint16_t max_tx_desc;
-    struct ether_addr hwaddr;
+
+    /* the bond port replaces its slaves here */
+    uint8_t port_num;
+    uint8_t port_ids[NETDEV_MAX_PORTS];
+    struct rte_kni *knis[NETDEV_MAX_PORTS];
+
+    /* with kni-queue, rx queue kni_queue_id of each port gets the non-dns traffic */
+    uint8_t kni_queue;
+    uint16_t kni_queue_id;
+
+    uint16_t worker_num;
+    unsigned workers[RTE_MAX_LCORE];
+
+    /* reta of each port, reta_size 0 when it cannot be rebalanced */
+    uint16_t reta_size[NETDEV_MAX_PORTS];
+    uint16_t reta[NETDEV_MAX_PORTS][NETIF_RETA_MAX];
+    uint32_t reta_prev_hits[NETDEV_MAX_PORTS][NETIF_RETA_MAX];
+
+    /* checksum offloads of the responses, 0 when done in software */
+    uint64_t tx_ol_flags[RTE_MAX_ETHPORTS];
 
     struct netif_queue_conf l_netif_queue_conf[RTE_MAX_LCORE];
 };
 
+/* ipv4 without options over udp, as classified by the nic */
+#define NETIF_PTYPE_IPV4_UDP    (RTE_PTYPE_L2_ETHER | RTE_PTYPE_L3_IPV4 | RTE_PTYPE_L4_UDP)
+#define NETIF_PTYPE_MASK        (RTE_PTYPE_L2_MASK | RTE_PTYPE_L3_MASK | RTE_PTYPE_L4_MASK)
+
+/* number of leading mbufs that share the port of the first one */
+static inline uint16_t netif_port_run(struct rte_mbuf **mbufs, uint16_t nb_mbufs) {
+    uint16_t n = 1;
+
+    while (n < nb_mbufs && mbufs[n]->port == mbufs[0]->port) {
+        n++;
+    }
+    return n;
+}
+
 int netdev_mode_parse(const char *entry);
 
+int netdev_ports_parse(const char *entry, uint8_t *port_ids, int max_num);
+
+int netdev_local_addrs_parse(const char *entry, uint32_t *addrs, int max_num);
+
+int netdev_bond_mode_parse(const char *entry);
+
+const char *netdev_bond_mode_str(int mode);
+
+uint8_t netif_port_num(void);
+
+uint8_t netif_port_id(uint8_t idx);
+
+uint16_t netif_worker_num(void);
+
+unsigned netif_worker_lcore(uint16_t idx);
+
 struct netif_queue_conf *netif_queue_conf_get(uint16_t lcore_id);
 
 int kdns_netdev_init(void);
@@ -69,12 +154,19 @@ void kni_egress(struct rte_mbuf **mbufs, uint16_t nb_mbufs);
 
 int kni_ingress(struct rte_mbuf **mbufs, uint16_t nb_mbufs);
 
+int kni_queue_ingress(struct rte_mbuf **mbufs, uint16_t nb_mbufs);
+
+void netif_reta_rebalance(void);
+
+/* turn an arp request or icmp echo for a local address into its reply in place, 1 when it is to be sent back */
+int netif_local_reply(struct rte_mbuf *m, struct netif_queue_stats *stats);
+
 void netif_statsdata_get(struct netif_queue_stats *sta);
 
 void netif_statsdata_reset(void);
 
 void netif_statsdata_metrics_reset(void);
 
-void init_dns_packet_header(struct ether_hdr *eth_hdr, struct ipv4_hdr *ipv4_hdr, struct udp_hdr *udp_hdr, uint16_t data_len);
+void init_dns_packet_header(struct rte_mbuf *pkt, struct ether_hdr *eth_hdr, struct ipv4_hdr *ipv4_hdr, struct udp_hdr *udp_hdr, uint16_t data_len);
 
 #endif
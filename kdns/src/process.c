@@ -12,6 +12,9 @@
 #include <rte_kni.h>
 #include <rte_arp.h>
 #include <rte_icmp.h>
+#include <rte_power.h>
+#include <rte_hash_crc.h>
+#include <unistd.h>
 
 #include "rte_cycles.h"
 
@@ -28,82 +31,197 @@
 #include "dns-conf.h"
 #include "rate_limit.h"
 #include "ctrl_msg.h"
+#include "zonefile.h"
+#include "snapshot.h"
+#include "journal.h"
 
 #define PREFETCH_OFFSET     (3)
 #define UDP_PORT_53         (0x3500)    // port 53
 
+/* consecutive empty polls before an lcore pauses, then sleeps */
+#define IDLE_PAUSE_POLLS    (64)
+#define IDLE_SLEEP_POLLS    (1024)
+#define MASTER_MAX_SLEEP_US (1000)
+
+struct idle_state {
+    uint32_t polls;
+    uint32_t sleep_us;
+    uint8_t power;      /* rte_power usable on the lcore */
+    uint8_t scaled;     /* frequency lowered while sleeping at max_sleep_us */
+};
+
+extern struct kdns dpdk_dns[MAX_CORES];
 extern int dns_reload;
 extern char *dns_cfgfile;
 extern char *dns_procname;
 
-static int tx_msg_slave_process(ctrl_msg *msg, unsigned slave_lcore) {
-    ctrl_mbufs_msg *mmsg = (ctrl_mbufs_msg *)msg;
+/* back to busy polling on any work */
+static inline void idle_reset(struct idle_state *idle, unsigned lcore_id) {
+    if (unlikely(idle->scaled)) {
+        rte_power_freq_max(lcore_id);
+        idle->scaled = 0;
+    }
+    idle->polls = 0;
+    idle->sleep_us = 0;
+}
+
+/* busy poll, then pause, then sleep doubling up to max_sleep_us and lower the frequency there */
+static void idle_backoff(struct idle_state *idle, uint32_t max_sleep_us, unsigned lcore_id) {
+    if (++idle->polls < IDLE_PAUSE_POLLS) {
+        return;
+    }
+    if (idle->polls < IDLE_SLEEP_POLLS || max_sleep_us == 0) {
+        rte_pause();
+        return;
+    }
 
-    struct netif_queue_conf *conf = netif_queue_conf_get(slave_lcore);
-    uint16_t cnts = rte_eth_tx_burst(conf->port_id, conf->tx_queue_id, mmsg->mbufs, mmsg->mbufs_cnts);
-    if (unlikely(cnts < mmsg->mbufs_cnts)) {
-        log_msg(LOG_ERR, "Failed to send %u pkt to tx_queue %u on slave_lcore %u\n", mmsg->mbufs_cnts - cnts, conf->tx_queue_id, slave_lcore);
+    idle->sleep_us = idle->sleep_us ? RTE_MIN(idle->sleep_us * 2, max_sleep_us) : 1;
+    if (idle->power && !idle->scaled && idle->sleep_us == max_sleep_us) {
+        rte_power_freq_min(lcore_id);
+        idle->scaled = 1;
+    }
+    usleep(idle->sleep_us);
+}
+
+/* kni and forward mbufs leave through the port the request came in */
+static uint16_t tx_ring_slave_process(struct netif_queue_conf *conf, unsigned slave_lcore) {
+    uint16_t i, run, cnts, nb;
+    struct rte_mbuf *mbufs[NETIF_MAX_PKT_BURST];
+
+    nb = rte_ring_sc_dequeue_burst(conf->tx_ring, (void **)mbufs, NETIF_MAX_PKT_BURST);
+    for (i = 0; i < nb; i += run) {
+        run = netif_port_run(mbufs + i, nb - i);
+        cnts = rte_eth_tx_burst(mbufs[i]->port, conf->tx_queue_id, mbufs + i, run);
+        if (unlikely(cnts < run)) {
+            log_msg(LOG_ERR, "Failed to send %u pkt to port %u tx_queue %u on slave_lcore %u\n", run - cnts, mbufs[i]->port, conf->tx_queue_id, slave_lcore);
+            do {
+                rte_pktmbuf_free(mbufs[i + cnts]);
+            } while (++cnts < run);
+        }
+    }
+    return nb;
+}
+
+/* round robin over the lcores owning a tx queue */
+static void tx_ring_slave_ingress(struct rte_mbuf **mbufs, uint16_t rx_len) {
+    uint16_t cnts;
+    static uint16_t worker_idx = 0;
+
+    worker_idx = (worker_idx + 1) % netif_worker_num();
+    unsigned kni_slave_lcore = netif_worker_lcore(worker_idx);
+    struct netif_queue_conf *conf = netif_queue_conf_get(kni_slave_lcore);
+    cnts = rte_ring_sp_enqueue_burst(conf->tx_ring, (void **)mbufs, rx_len);
+    if (unlikely(cnts < rx_len)) {
+        log_msg(LOG_ERR, "Failed to send %u pkt to tx ring of slave_lcore %u\n", rx_len - cnts, kni_slave_lcore);
         do {
-            rte_pktmbuf_free(mmsg->mbufs[cnts]);
-        } while (++cnts < mmsg->mbufs_cnts);
+            rte_pktmbuf_free(mbufs[cnts]);
+        } while (++cnts < rx_len);
     }
-    free(mmsg);
-    return 0;
 }
 
-static void tx_msg_slave_ingress(struct rte_mbuf **mbufs, uint16_t rx_len) {
-    uint16_t i;
-    static unsigned kni_slave_lcore = 0;
+static uint16_t kni_ring_master_process(struct rte_mbuf **mbufs) {
+    uint16_t nb, nb_all = 0;
+    unsigned lcore_id;
+
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+        nb = rte_ring_sc_dequeue_burst(netif_queue_conf_get(lcore_id)->kni_ring, (void **)mbufs, NETIF_MAX_PKT_BURST);
+        if (nb > 0) {
+            kni_egress(mbufs, nb);
+            nb_all += nb;
+        }
+    }
+    return nb_all;
+}
+
+static void kni_ring_master_ingress(struct rte_mbuf **mbufs, uint16_t rx_len, struct netif_queue_conf *conf) {
+    uint16_t cnts = rte_ring_sp_enqueue_burst(conf->kni_ring, (void **)mbufs, rx_len);
 
-    ctrl_mbufs_msg *msg = xalloc_zero(sizeof(ctrl_mbufs_msg));
-    msg->cmsg.type = CTRL_MSG_TYPE_MBUF_TO_TX;
-    msg->cmsg.len = sizeof(ctrl_mbufs_msg);
-    msg->mbufs_cnts = rx_len;
-    for (i = 0; i < rx_len; ++i) {
-        msg->mbufs[i] = mbufs[i];
+    conf->stats.pkts_2kni += (uint64_t)cnts;
+    if (unlikely(cnts < rx_len)) {
+        log_msg(LOG_ERR, "Failed to send %u pkt to kni ring\n", rx_len - cnts);
+        conf->stats.pkt_dropped += (uint64_t)(rx_len - cnts);
+        do {
+            rte_pktmbuf_free(mbufs[cnts]);
+        } while (++cnts < rx_len);
     }
+}
+
+/* arp and icmp echo replies are rare, they leave at once without counting as dns */
+static void local_reply_send(struct rte_mbuf *pkt, struct netif_queue_conf *conf) {
+    if (unlikely(rte_eth_tx_burst(pkt->port, conf->tx_queue_id, &pkt, 1) == 0)) {
+        conf->stats.pkt_dropped++;
+        rte_pktmbuf_free(pkt);
+    }
+}
 
-    kni_slave_lcore = rte_get_next_lcore(kni_slave_lcore, 1, 1);
-    int s_cnt = ctrl_msg_slave_ingress((void **)&msg, 1, kni_slave_lcore);
-    if (s_cnt != 1) {
-        log_msg(LOG_ERR, "Failed to send %u pkt to tx msg to slave_lcore %u\n", rx_len, kni_slave_lcore);
-        for (i = 0; i < rx_len; i++) {
-            rte_pktmbuf_free(mbufs[i]);
+/* master answers what the kni queue brings, replies go out through a slave's tx ring */
+static void kni_queue_process(struct rte_mbuf **mbufs, uint16_t nb_mbufs) {
+    uint16_t i, nb_kni = 0, nb_reply = 0;
+    struct rte_mbuf *replies[NETIF_MAX_PKT_BURST];
+    struct netif_queue_stats *stats = &netif_queue_conf_get(rte_lcore_id())->stats;
+
+    for (i = 0; i < nb_mbufs; i++) {
+        if (netif_local_reply(mbufs[i], stats)) {
+            replies[nb_reply++] = mbufs[i];
+        } else {
+            mbufs[nb_kni++] = mbufs[i];
         }
-        free(msg);
+    }
+    if (nb_reply > 0) {
+        tx_ring_slave_ingress(replies, nb_reply);
+    }
+    if (nb_kni > 0) {
+        kni_egress(mbufs, nb_kni);
     }
 }
 
-static int kni_msg_master_process(ctrl_msg *msg) {
-    ctrl_mbufs_msg *mmsg = (ctrl_mbufs_msg *)msg;
+/* copy the reassembled chain into the first segment, queries are answered in place */
+static int frag_linearize(struct rte_mbuf *pkt) {
+    struct rte_mbuf *seg;
+    char *dst;
 
-    kni_egress(mmsg->mbufs, mmsg->mbufs_cnts);
-    free(mmsg);
+    if (pkt->nb_segs == 1) {
+        return 0;
+    }
+    if (rte_pktmbuf_tailroom(pkt) < pkt->pkt_len - pkt->data_len) {
+        return -1;
+    }
+    dst = rte_pktmbuf_mtod_offset(pkt, char *, pkt->data_len);
+    for (seg = pkt->next; seg != NULL; seg = seg->next) {
+        rte_memcpy(dst, rte_pktmbuf_mtod(seg, void *), seg->data_len);
+        dst += seg->data_len;
+    }
+    rte_pktmbuf_free(pkt->next);
+    pkt->next = NULL;
+    pkt->nb_segs = 1;
+    pkt->data_len = pkt->pkt_len;
     return 0;
 }
 
-static void kni_msg_master_ingress(struct rte_mbuf **mbufs, uint16_t rx_len, struct netif_queue_conf *conf) {
-    uint16_t i;
+/* NULL while the datagram is incomplete, the fragments stay in the table or go to the death row */
+static struct rte_mbuf *frag_reassemble(struct rte_mbuf *pkt, struct ipv4_hdr *ipv4_hdr, uint16_t ip_total_length, struct netif_queue_conf *conf) {
+    struct rte_mbuf *mo;
 
-    ctrl_mbufs_msg *msg = xalloc_zero(sizeof(ctrl_mbufs_msg));
-    msg->cmsg.type = CTRL_MSG_TYPE_MBUF_TO_KNI;
-    msg->cmsg.len = sizeof(ctrl_mbufs_msg);
-    msg->mbufs_cnts = rx_len;
-    for (i = 0; i < rx_len; ++i) {
-        msg->mbufs[i] = mbufs[i];
+    conf->stats.pkts_frag++;
+    /* drop the ethernet padding of a short last fragment */
+    if (pkt->pkt_len > sizeof(struct ether_hdr) + ip_total_length) {
+        rte_pktmbuf_trim(pkt, pkt->pkt_len - sizeof(struct ether_hdr) - ip_total_length);
     }
+    pkt->l2_len = sizeof(struct ether_hdr);
+    pkt->l3_len = sizeof(struct ipv4_hdr);
 
-    int s_cnt = ctrl_msg_master_ingress((void **)&msg, 1);
-    if (s_cnt != 1) {
-        log_msg(LOG_ERR, "Failed to send %u pkt to kni msg\n", rx_len);
-        conf->stats.pkt_dropped += (uint64_t)rx_len;
-        for (i = 0; i < rx_len; i++) {
-            rte_pktmbuf_free(mbufs[i]);
-        }
-        free(msg);
-    } else {
-        conf->stats.pkts_2kni += (uint64_t)rx_len;
+    mo = rte_ipv4_frag_reassemble_packet(conf->frag_tbl, &conf->frag_dr, pkt, rte_rdtsc(), ipv4_hdr);
+    if (mo == NULL) {
+        return NULL;
+    }
+    if (unlikely(frag_linearize(mo) < 0)) {
+        log_msg(LOG_ERR, "reassembled pkt too large: pkt_len(%d)\n", mo->pkt_len);
+        conf->stats.frag_dropped++;
+        conf->stats.pkt_dropped++;
+        rte_pktmbuf_free(mo);
+        return NULL;
     }
+    return mo;
 }
 
 static int packet_process(struct rte_mbuf *pkt, struct netif_queue_conf *conf, unsigned lcore_id) {
@@ -119,8 +237,15 @@ static int packet_process(struct rte_mbuf *pkt, struct netif_queue_conf *conf, u
     uint64_t start_time = time_now_usec();
 #endif
 
+    /* headers classified by the nic are not checked again */
+    int classified = ((pkt->packet_type & NETIF_PTYPE_MASK) == NETIF_PTYPE_IPV4_UDP);
+
     conf->stats.pkts_rcv++;
-    if (unlikely(eth_hdr->ether_type != rte_cpu_to_be_16(ETHER_TYPE_IPv4))) {
+    if (unlikely(!classified && eth_hdr->ether_type != rte_cpu_to_be_16(ETHER_TYPE_IPv4))) {
+        if (netif_local_reply(pkt, &conf->stats)) {
+            local_reply_send(pkt, conf);
+            return 0;
+        }
         conf->kni_mbufs[conf->kni_len++] = pkt;
         return 0;
     }
@@ -129,7 +254,7 @@ static int packet_process(struct rte_mbuf *pkt, struct netif_queue_conf *conf, u
         rte_pktmbuf_free(pkt);
         return 0;
     }
-    uint16_t ip_hdr_len = (ipv4_hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
+    uint16_t ip_hdr_len = classified ? sizeof(struct ipv4_hdr) : (ipv4_hdr->version_ihl & IPV4_HDR_IHL_MASK) * IPV4_IHL_MULTIPLIER;
     uint16_t ip_total_length = rte_be_to_cpu_16(ipv4_hdr->total_length);
     if (unlikely(ip_hdr_len != sizeof(struct ipv4_hdr) || ip_total_length < ip_hdr_len || pkt->pkt_len < (sizeof(struct ether_hdr) + ip_total_length))) {
         log_msg(LOG_ERR, "illegal pkt: pkt_len(%d), ip_hdr_len(%d), ip_total_length(%d)\n", pkt->pkt_len, ip_hdr_len, ip_total_length);
@@ -138,7 +263,25 @@ static int packet_process(struct rte_mbuf *pkt, struct netif_queue_conf *conf, u
         rte_pktmbuf_free(pkt);
         return 0;
     }
-    if (unlikely(ipv4_hdr->next_proto_id != IPPROTO_UDP || udp_hdr->dst_port != UDP_PORT_53)) {
+    if (unlikely(!classified && rte_ipv4_frag_pkt_is_fragmented(ipv4_hdr))) {
+        if (conf->frag_tbl == NULL || ipv4_hdr->next_proto_id != IPPROTO_UDP) {
+            conf->kni_mbufs[conf->kni_len++] = pkt;
+            return 0;
+        }
+        pkt = frag_reassemble(pkt, ipv4_hdr, ip_total_length, conf);
+        if (pkt == NULL) {
+            return 0;
+        }
+        eth_hdr = rte_pktmbuf_mtod(pkt, struct ether_hdr *);
+        ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct ipv4_hdr *, ether_hdr_offset);
+        udp_hdr = rte_pktmbuf_mtod_offset(pkt, struct udp_hdr *, ip_hdr_offset);
+        ip_total_length = rte_be_to_cpu_16(ipv4_hdr->total_length);
+    }
+    if (unlikely((!classified && ipv4_hdr->next_proto_id != IPPROTO_UDP) || udp_hdr->dst_port != UDP_PORT_53)) {
+        if (ipv4_hdr->next_proto_id == IPPROTO_ICMP && netif_local_reply(pkt, &conf->stats)) {
+            local_reply_send(pkt, conf);
+            return 0;
+        }
         conf->kni_mbufs[conf->kni_len++] = pkt;
         return 0;
     }
@@ -174,12 +317,10 @@ static int packet_process(struct rte_mbuf *pkt, struct netif_queue_conf *conf, u
 
     int ret_len = buffer_remaining(query->packet);
     if (likely(ret_len > 0)) {
-        init_dns_packet_header(eth_hdr, ipv4_hdr, udp_hdr, ret_len);
+        init_dns_packet_header(pkt, eth_hdr, ipv4_hdr, udp_hdr, ret_len);
         pkt->pkt_len = ret_len + udp_hdr_offset;
         pkt->data_len = pkt->pkt_len;
-        pkt->l2_len = sizeof(struct ether_hdr);
         pkt->vlan_tci = ETHER_TYPE_IPv4;
-        pkt->l3_len = sizeof(struct ipv4_hdr);
 
         conf->tx_mbufs[conf->tx_len++] = pkt;
         conf->stats.dns_lens_snd += pkt->pkt_len;
@@ -196,9 +337,145 @@ static int packet_process(struct rte_mbuf *pkt, struct netif_queue_conf *conf, u
     return 0;
 }
 
+static void burst_process(struct rte_mbuf **mbufs, uint16_t rx_count, struct netif_queue_conf *conf, unsigned lcore_id) {
+    int i, ntx, run;
+
+    conf->tx_len = 0;
+    conf->kni_len = 0;
+
+    /* Prefetch PREFETCH_OFFSET packets */
+    for (i = 0; i < PREFETCH_OFFSET && i < rx_count; i++) {
+        rte_prefetch0(rte_pktmbuf_mtod(mbufs[i], void *));
+    }
+
+    /* Prefetch and Deal already prefetched packets. */
+    for (i = 0; i < (rx_count - PREFETCH_OFFSET); i++) {
+        rte_prefetch0(rte_pktmbuf_mtod(mbufs[i + PREFETCH_OFFSET], void *));
+        packet_process(mbufs[i], conf, lcore_id);
+    }
+
+    /* Deal remaining prefetched packets */
+    for (; i < rx_count; i++) {
+        packet_process(mbufs[i], conf, lcore_id);
+    }
+
+    // send the pkts, each through the port it came in
+    for (i = 0; i < conf->tx_len; i += run) {
+        struct rte_mbuf **tx_mbufs = conf->tx_mbufs + i;
+        run = netif_port_run(tx_mbufs, conf->tx_len - i);
+        ntx = rte_eth_tx_burst(tx_mbufs[0]->port, conf->tx_queue_id, tx_mbufs, run);
+        conf->stats.dns_pkts_snd += ntx;
+        if (unlikely(ntx != run)) {
+            log_msg(LOG_ERR, "rx=%d, tx=%d, failed tx=%d, on port=%u slave=%u\n", rx_count, run, run - ntx, tx_mbufs[0]->port, lcore_id);
+            conf->stats.pkt_dropped += run - ntx;
+            do {
+                rte_pktmbuf_free(tx_mbufs[ntx]);
+            } while (++ntx < run);
+        }
+    }
+    // snd to master
+    if (unlikely(conf->kni_len > 0)) {
+        kni_ring_master_ingress(conf->kni_mbufs, conf->kni_len, conf);
+    }
+    // fragments timed out or over the table
+    if (unlikely(conf->frag_dr.cnt > 0)) {
+        conf->stats.frag_dropped += conf->frag_dr.cnt;
+        conf->stats.pkt_dropped += conf->frag_dr.cnt;
+        rte_ip_frag_free_death_row(&conf->frag_dr, PREFETCH_OFFSET);
+    }
+}
+
+/* the bonding pmd leaves the slave port in mbuf->port, kni and forward route by it */
+static inline uint16_t port_rx_burst(struct netif_queue_conf *conf, uint8_t p, struct rte_mbuf **mbufs) {
+    uint8_t port_id = conf->port_ids[p];
+    uint16_t i, rx_count = rte_eth_rx_burst(port_id, conf->rx_queue_id, mbufs, NETIF_MAX_PKT_BURST);
+    uint32_t *reta_hits = conf->reta_hits ? conf->reta_hits + p * NETIF_RETA_MAX : NULL;
+
+    for (i = 0; i < rx_count; i++) {
+        mbufs[i]->port = port_id;
+        if (reta_hits && (mbufs[i]->ol_flags & PKT_RX_RSS_HASH)) {
+            reta_hits[mbufs[i]->hash.rss & conf->reta_mask[p]]++;
+        }
+    }
+    return rx_count;
+}
+
+/* a client always lands on the same worker, so its rate limit stays on one lcore; with rss-udp the rss hash covers the ports */
+static inline uint32_t dist_hash(struct rte_mbuf *m) {
+    if ((m->ol_flags & PKT_RX_RSS_HASH) && !g_dns_cfg->netdev.rss_udp) {
+        return m->hash.rss;
+    }
+    struct ether_hdr *eth_hdr = rte_pktmbuf_mtod(m, struct ether_hdr *);
+    if (eth_hdr->ether_type != rte_cpu_to_be_16(ETHER_TYPE_IPv4)) {
+        return 0;
+    }
+    struct ipv4_hdr *ipv4_hdr = (struct ipv4_hdr *)(eth_hdr + 1);
+    return rte_hash_crc_4byte(ipv4_hdr->src_addr, 0);
+}
+
+struct dist_worker {
+    struct rte_ring *ring;
+    uint16_t len;
+    struct rte_mbuf *mbufs[NETIF_MAX_PKT_BURST];
+};
+
+static struct dist_worker *dist_init(struct netif_queue_conf *conf, unsigned lcore_id) {
+    uint16_t w, worker_num = netif_worker_num();
+    struct dist_worker *workers = rte_zmalloc_socket(NULL, worker_num * sizeof(struct dist_worker), RTE_CACHE_LINE_SIZE, rte_socket_id());
+
+    if (workers == NULL) {
+        log_msg(LOG_ERR, "Cannot alloc workers of rx core %u\n", lcore_id);
+        exit(-1);
+    }
+    for (w = 0; w < worker_num; w++) {
+        workers[w].ring = netif_queue_conf_get(netif_worker_lcore(w))->dist_rings[conf->role_idx];
+    }
+    return workers;
+}
+
+static void dist_worker_flush(struct dist_worker *worker, struct netif_queue_conf *conf) {
+    uint16_t cnts = rte_ring_sp_enqueue_burst(worker->ring, (void **)worker->mbufs, worker->len);
+
+    if (unlikely(cnts < worker->len)) {
+        conf->stats.pkt_dropped += worker->len - cnts;
+        do {
+            rte_pktmbuf_free(worker->mbufs[cnts]);
+        } while (++cnts < worker->len);
+    }
+    worker->len = 0;
+}
+
+/* rx lcore: spread the bursts of its queue over the workers by client */
+static uint32_t dist_process(struct dist_worker *workers, struct netif_queue_conf *conf) {
+    uint8_t p;
+    uint16_t i, w, rx_count, worker_num = netif_worker_num();
+    uint32_t nb_rx = 0;
+    struct rte_mbuf *mbufs[NETIF_MAX_PKT_BURST];
+
+    for (p = 0; p < conf->port_num; p++) {
+        rx_count = port_rx_burst(conf, p, mbufs);
+        for (i = 0; i < rx_count; i++) {
+            w = dist_hash(mbufs[i]) % worker_num;
+            workers[w].mbufs[workers[w].len++] = mbufs[i];
+            if (workers[w].len == NETIF_MAX_PKT_BURST) {
+                dist_worker_flush(&workers[w], conf);
+            }
+        }
+        nb_rx += rx_count;
+    }
+    for (w = 0; w < worker_num && nb_rx > 0; w++) {
+        if (workers[w].len > 0) {
+            dist_worker_flush(&workers[w], conf);
+        }
+    }
+    return nb_rx;
+}
+
 int process_slave(__attribute__((unused)) void *arg) {
-    int i;
+    uint8_t p;
     uint16_t rx_count, ctrl_msg_count = 0;
+    uint32_t nb_work;
+    struct dist_worker *workers = NULL;
     uint64_t now_tsc, prev_tsc, intvl_tsc;
     struct rte_mbuf *mbufs[NETIF_MAX_PKT_BURST];
     unsigned lcore_id = rte_lcore_id();
@@ -212,58 +489,65 @@ int process_slave(__attribute__((unused)) void *arg) {
     prev_tsc = now_tsc;
     intvl_tsc = rte_get_timer_hz() / 1000;  //1ms
 
-    kdns_init(zones, lcore_id);
-    rate_limit_init(all_per_second, fwd_per_second, client_num, lcore_id);
+    uint32_t idle_sleep_us = g_dns_cfg->netdev.idle_sleep_us;
+    struct idle_state idle = {0};
 
+    /* rx lcores only distribute packets, they keep no store and get no ctrl msgs */
     struct netif_queue_conf *conf = netif_queue_conf_get(lcore_id);
-    log_msg(LOG_INFO, "Starting slave on core %u: rx %u, tx %u\n", lcore_id, conf->rx_queue_id, conf->tx_queue_id);
+    if (conf->role != NETIF_ROLE_RX) {
+        kdns_init(zones, lcore_id);
+        rate_limit_init(all_per_second, fwd_per_second, client_num, lcore_id);
+    }
+    if (g_dns_cfg->netdev.power_scale && idle_sleep_us > 0) {
+        if (rte_power_init(lcore_id) == 0) {
+            idle.power = 1;
+        } else {
+            log_msg(LOG_ERR, "Cannot init power management on core %u, frequency unchanged\n", lcore_id);
+        }
+    }
+
+    if (conf->role == NETIF_ROLE_RX) {
+        workers = dist_init(conf, lcore_id);
+    }
+    log_msg(LOG_INFO, "Starting slave on core %u: role %u, ports %u, rx %u, tx %u\n", lcore_id, conf->role, conf->port_num, conf->rx_queue_id, conf->tx_queue_id);
     while (1) {
         now_tsc = rte_rdtsc();
-        if (ctrl_msg_count || now_tsc - prev_tsc > intvl_tsc) {
+        if (conf->role != NETIF_ROLE_RX && (ctrl_msg_count || now_tsc - prev_tsc > intvl_tsc)) {
             prev_tsc = now_tsc;
+            /* the rrsets updated by a burst of msgs are indexed once */
+            domain_store_batch_begin(dpdk_dns[lcore_id].db);
             ctrl_msg_count = ctrl_msg_slave_process(lcore_id);
+            domain_store_batch_end(dpdk_dns[lcore_id].db);
         }
 
-        rx_count = rte_eth_rx_burst(conf->port_id, conf->rx_queue_id, mbufs, NETIF_MAX_PKT_BURST);
-        if (unlikely(rx_count == 0)) {
-            continue;
-        }
-
-        conf->tx_len = 0;
-        conf->kni_len = 0;
+        nb_work = ctrl_msg_count + tx_ring_slave_process(conf, lcore_id);
 
-        /* Prefetch PREFETCH_OFFSET packets */
-        for (i = 0; i < PREFETCH_OFFSET && i < rx_count; i++) {
-            rte_prefetch0(rte_pktmbuf_mtod(mbufs[i], void *));
-        }
-
-        /* Prefetch and Deal already prefetched packets. */
-        for (i = 0; i < (rx_count - PREFETCH_OFFSET); i++) {
-            rte_prefetch0(rte_pktmbuf_mtod(mbufs[i + PREFETCH_OFFSET], void *));
-            packet_process(mbufs[i], conf, lcore_id);
-        }
-
-        /* Deal remaining prefetched packets */
-        for (; i < rx_count; i++) {
-            packet_process(mbufs[i], conf, lcore_id);
-        }
-
-        // send the pkts
-        if (likely(conf->tx_len > 0)) {
-            int ntx = rte_eth_tx_burst(conf->port_id, conf->tx_queue_id, conf->tx_mbufs, conf->tx_len);
-            conf->stats.dns_pkts_snd += ntx;
-            if (unlikely(ntx != conf->tx_len)) {
-                log_msg(LOG_ERR, "rx=%d, tx=%d, failed tx=%d, on slave=%u\n", rx_count, conf->tx_len, conf->tx_len - ntx, lcore_id);
-                int i = 0;
-                for (i = ntx; i < conf->tx_len; i++) {
-                    rte_pktmbuf_free(conf->tx_mbufs[i]);
+        if (conf->role == NETIF_ROLE_RXTX) {
+            for (p = 0; p < conf->port_num; p++) {
+                rx_count = port_rx_burst(conf, p, mbufs);
+                if (unlikely(rx_count == 0)) {
+                    continue;
+                }
+                nb_work += rx_count;
+                burst_process(mbufs, rx_count, conf, lcore_id);
+            }
+        } else if (conf->role == NETIF_ROLE_RX) {
+            nb_work += dist_process(workers, conf);
+        } else {
+            for (p = 0; p < g_dns_cfg->netdev.rx_lcores; p++) {
+                rx_count = rte_ring_sc_dequeue_burst(conf->dist_rings[p], (void **)mbufs, NETIF_MAX_PKT_BURST);
+                if (rx_count == 0) {
+                    continue;
                 }
-                conf->stats.pkt_dropped += ntx;
+                nb_work += rx_count;
+                burst_process(mbufs, rx_count, conf, lcore_id);
             }
         }
-        // snd to master
-        if (unlikely(conf->kni_len > 0)) {
-            kni_msg_master_ingress(conf->kni_mbufs, conf->kni_len, conf);
+
+        if (likely(nb_work > 0)) {
+            idle_reset(&idle, lcore_id);
+        } else {
+            idle_backoff(&idle, idle_sleep_us, lcore_id);
         }
     }
     return 0;
@@ -297,7 +581,10 @@ static int reset_master_affinity(void) {
 }
 
 int process_master(__attribute__((unused)) void *arg) {
-    uint16_t nb_ctrl = 0, nb_kni = 0, nb_fwd = 0;
+    uint16_t nb_ctrl = 0, nb_kni = 0, nb_fwd = 0, nb_kniq = 0;
+    struct idle_state idle = {0};
+    uint64_t now_tsc, reta_prev_tsc = rte_rdtsc();
+    uint64_t reta_intvl_tsc = rte_get_timer_hz() * g_dns_cfg->netdev.reta_interval;
     struct rte_mbuf *mbufs[NETIF_MAX_PKT_BURST];
     unsigned lcore_id = rte_lcore_id();
 
@@ -309,10 +596,16 @@ int process_master(__attribute__((unused)) void *arg) {
     domain_info_master_init();
     view_master_init();
 
-    ctrl_msg_reg(CTRL_MSG_TYPE_MBUF_TO_KNI, 0, kni_msg_master_process, NULL);
-    ctrl_msg_reg(CTRL_MSG_TYPE_MBUF_TO_TX, 0, NULL, tx_msg_slave_process);
+    //restored msgs are queued before any api msg, the journal goes last so its api changes are not overwritten.
+    //zone file reloads are journaled too, a zone the journal replaces again is not loaded from its file
+    uint64_t generation = 0;
+    snapshot_restore(g_dns_cfg->comm.snapshot_file, &generation);
+    journal_scan(g_dns_cfg->comm.journal_file, generation);
+    zonefiles_startup_load(g_dns_cfg->comm.zone_files);
+    journal_init(g_dns_cfg->comm.journal_file, g_dns_cfg->comm.journal_commit_ms, generation);
 
     domian_info_exchange_run(web_port, ssl_enable, key_pem_file, cert_pem_file);
+    snapshot_init(g_dns_cfg->comm.snapshot_file, g_dns_cfg->comm.snapshot_interval);
 
     reset_master_affinity();
     log_msg(LOG_INFO, "Starting master on core %u\n", lcore_id);
@@ -325,18 +618,32 @@ int process_master(__attribute__((unused)) void *arg) {
 
         nb_ctrl = ctrl_msg_master_process();
 
+        now_tsc = rte_rdtsc();
+        if (reta_intvl_tsc && now_tsc - reta_prev_tsc > reta_intvl_tsc) {
+            reta_prev_tsc = now_tsc;
+            netif_reta_rebalance();
+        }
+
         nb_kni = kni_ingress(mbufs, NETIF_MAX_PKT_BURST);
         if (nb_kni > 0) {
-            tx_msg_slave_ingress(mbufs, nb_kni);
+            tx_ring_slave_ingress(mbufs, nb_kni);
+        }
+        nb_kni += kni_ring_master_process(mbufs);
+
+        nb_kniq = kni_queue_ingress(mbufs, NETIF_MAX_PKT_BURST);
+        if (nb_kniq > 0) {
+            kni_queue_process(mbufs, nb_kniq);
         }
 
         nb_fwd = fwd_response_dequeue(mbufs, NETIF_MAX_PKT_BURST);
         if (nb_fwd > 0) {
-            tx_msg_slave_ingress(mbufs, nb_fwd);
+            tx_ring_slave_ingress(mbufs, nb_fwd);
         }
 
-        if (nb_ctrl == 0 && nb_kni == 0 && nb_fwd == 0) {
-            rte_delay_ms(1);
+        if (nb_ctrl == 0 && nb_kni == 0 && nb_kniq == 0 && nb_fwd == 0) {
+            idle_backoff(&idle, MASTER_MAX_SLEEP_US, lcore_id);
+        } else {
+            idle_reset(&idle, lcore_id);
         }
     }
 
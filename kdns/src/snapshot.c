@@ -0,0 +1,391 @@
+/*
+ * snapshot.c
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <rte_common.h>
+#include <rte_hash_crc.h>
+
+#include "util.h"
+#include "db_update.h"
+#include "domain_update.h"
+#include "view_update.h"
+#include "journal.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC          "KDNSSNAP"
+#define SNAPSHOT_VERSION        (2)
+#define SNAPSHOT_INIT_BUF_SIZE  (1 << 20)
+
+/* the records follow the header, strings are stored as u8 len + bytes */
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t view_num;
+    uint32_t domain_num;
+    uint32_t data_len;
+    uint32_t checksum;
+    uint32_t reserved;
+    uint64_t create_time;
+    uint64_t generation;        //journal generation the snapshot covers
+};
+
+struct snapshot_domain {
+    uint32_t ttl;
+    uint32_t max_answer;
+    uint16_t type;
+    uint16_t prio;
+    uint16_t weight;
+    uint16_t port;
+    uint16_t lb_mode;
+    uint16_t lb_weight;
+} __attribute__((packed));
+
+struct snapshot_zone {
+    char zone_name[DB_MAX_NAME_LEN];
+    struct snapshot_buf buf;
+};
+
+static char *snapshot_path;
+static uint32_t snapshot_interval;
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void snapshot_buf_put(struct snapshot_buf *buf, const void *data, uint32_t len) {
+    if (buf->len + len > buf->size) {
+        while (buf->len + len > buf->size) {
+            buf->size *= 2;
+        }
+        buf->data = xrealloc(buf->data, buf->size);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+void snapshot_buf_put_str(struct snapshot_buf *buf, const char *str, size_t size) {
+    uint8_t len = (uint8_t)strnlen(str, RTE_MIN(size - 1, (size_t)UINT8_MAX));
+    snapshot_buf_put(buf, &len, sizeof(len));
+    snapshot_buf_put(buf, str, len);
+}
+
+static void snapshot_view_put(void *arg, view_value_t *data) {
+    struct snapshot_buf *buf = (struct snapshot_buf *)arg;
+
+    snapshot_buf_put_str(buf, data->cidrs, sizeof(data->cidrs));
+    snapshot_buf_put_str(buf, data->view_name, sizeof(data->view_name));
+    buf->view_num++;
+}
+
+void snapshot_domain_encode(struct snapshot_buf *buf, struct domin_info_update *update) {
+    struct snapshot_domain domain = {
+        .ttl = update->ttl,
+        .max_answer = update->maxAnswer,
+        .type = update->type,
+        .prio = update->prio,
+        .weight = update->weight,
+        .port = update->port,
+        .lb_mode = update->lb_mode,
+        .lb_weight = update->lb_weight,
+    };
+
+    snapshot_buf_put(buf, &domain, sizeof(domain));
+    snapshot_buf_put_str(buf, update->view_name, sizeof(update->view_name));
+    snapshot_buf_put_str(buf, update->type_str, sizeof(update->type_str));
+    snapshot_buf_put_str(buf, update->zone_name, sizeof(update->zone_name));
+    snapshot_buf_put_str(buf, update->domain_name, sizeof(update->domain_name));
+    snapshot_buf_put_str(buf, update->host, sizeof(update->host));
+}
+
+static void snapshot_domain_put(void *arg, struct domin_info_update *update) {
+    struct snapshot_buf *buf = (struct snapshot_buf *)arg;
+
+    snapshot_domain_encode(buf, update);
+    buf->domain_num++;
+}
+
+static int snapshot_write(const char *path, struct snapshot_header *header, struct snapshot_buf *buf) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log_msg(LOG_ERR, "open snapshot %s failed, errno=%d, errinfo=%s\n", tmp_path, errno, strerror(errno));
+        return -1;
+    }
+    if (write(fd, header, sizeof(*header)) != (ssize_t)sizeof(*header)
+            || write(fd, buf->data, buf->len) != (ssize_t)buf->len
+            || fsync(fd) < 0) {
+        log_msg(LOG_ERR, "write snapshot %s failed, errno=%d, errinfo=%s\n", tmp_path, errno, strerror(errno));
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+
+    //readers never see a half written snapshot
+    if (rename(tmp_path, path) < 0) {
+        log_msg(LOG_ERR, "rename snapshot %s failed, errno=%d, errinfo=%s\n", path, errno, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int snapshot_dump(const char *path) {
+    struct snapshot_header header;
+    struct snapshot_buf buf;
+    struct timeval start, end;
+    int ret;
+
+    if (path == NULL || strlen(path) == 0) {
+        log_msg(LOG_ERR, "snapshot file is not configured\n");
+        return -1;
+    }
+    gettimeofday(&start, NULL);
+
+    /* read before walking, every msg up to it is in the registry already.
+     * the ones applied during the walk get replayed again, which is harmless */
+    uint64_t generation = journal_generation();
+    memset(&buf, 0, sizeof(buf));
+    buf.size = SNAPSHOT_INIT_BUF_SIZE;
+    buf.data = xalloc(buf.size);
+    view_master_walk(&buf, snapshot_view_put);
+    domain_list_walk(&buf, snapshot_domain_put);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.view_num = buf.view_num;
+    header.domain_num = buf.domain_num;
+    header.data_len = buf.len;
+    header.checksum = rte_hash_crc(buf.data, buf.len, 0);
+    header.create_time = (uint64_t)time(NULL);
+    header.generation = generation;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    ret = snapshot_write(path, &header, &buf);
+    pthread_mutex_unlock(&snapshot_mutex);
+    free(buf.data);
+
+    gettimeofday(&end, NULL);
+    if (ret == 0) {
+        log_msg(LOG_INFO, "dump snapshot %s: %u views, %u domains, %u bytes, generation %lu, cost %ld ms\n", path,
+                header.view_num, header.domain_num, header.data_len, (unsigned long)generation,
+                (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000);
+        journal_compact(generation);
+    }
+    return ret;
+}
+
+int snapshot_get(const char **cur, const char *end, void *data, uint32_t len) {
+    if (*cur + len > end) {
+        return -1;
+    }
+    memcpy(data, *cur, len);
+    *cur += len;
+    return 0;
+}
+
+int snapshot_get_str(const char **cur, const char *end, char *str, size_t size) {
+    uint8_t len;
+
+    if (*cur + sizeof(len) > end) {
+        return -1;
+    }
+    len = *(const uint8_t *)(*cur);
+    if (*cur + sizeof(len) + len > end || len >= size) {
+        return -1;
+    }
+    memcpy(str, *cur + sizeof(len), len);
+    str[len] = '\0';
+    *cur += sizeof(len) + len;
+    return 0;
+}
+
+static struct snapshot_zone *snapshot_zone_get(struct snapshot_zone **zones, uint32_t *zone_num, uint32_t *last, const char *zone_name) {
+    uint32_t i;
+
+    if (*last < *zone_num && strcasecmp((*zones)[*last].zone_name, zone_name) == 0) {
+        return &(*zones)[*last];
+    }
+    for (i = 0; i < *zone_num; ++i) {
+        if (strcasecmp((*zones)[i].zone_name, zone_name) == 0) {
+            *last = i;
+            return &(*zones)[i];
+        }
+    }
+
+    *zones = xrealloc(*zones, (*zone_num + 1) * sizeof(struct snapshot_zone));
+    struct snapshot_zone *zone = &(*zones)[*zone_num];
+    snprintf(zone->zone_name, sizeof(zone->zone_name), "%s", zone_name);
+    zone_replace_init(&zone->buf);
+    *last = (*zone_num)++;
+    return zone;
+}
+
+int snapshot_domain_decode(const char **cur, const char *end, struct domin_info_update *update) {
+    struct snapshot_domain domain;
+
+    if (snapshot_get(cur, end, &domain, sizeof(domain)) < 0) {
+        return -1;
+    }
+    update->ttl = domain.ttl;
+    update->maxAnswer = domain.max_answer;
+    update->type = domain.type;
+    update->prio = domain.prio;
+    update->weight = domain.weight;
+    update->port = domain.port;
+    update->lb_mode = domain.lb_mode;
+    update->lb_weight = domain.lb_weight;
+    if (snapshot_get_str(cur, end, update->view_name, sizeof(update->view_name)) < 0
+            || snapshot_get_str(cur, end, update->type_str, sizeof(update->type_str)) < 0
+            || snapshot_get_str(cur, end, update->zone_name, sizeof(update->zone_name)) < 0
+            || snapshot_get_str(cur, end, update->domain_name, sizeof(update->domain_name)) < 0
+            || snapshot_get_str(cur, end, update->host, sizeof(update->host)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int snapshot_views_restore(const char **cur, const char *end, uint32_t view_num) {
+    uint32_t i;
+
+    for (i = 0; i < view_num; ++i) {
+        struct view_info_update *view = ctrl_msg_alloc(CTRL_MSG_TYPE_UPDATE_VIEW, sizeof(struct view_info_update));
+        view->action = ACTION_ADD;
+        view->cmsg.no_journal = 1;
+        if (snapshot_get_str(cur, end, view->cidrs, sizeof(view->cidrs)) < 0
+                || snapshot_get_str(cur, end, view->view_name, sizeof(view->view_name)) < 0) {
+            ctrl_msg_free(&view->cmsg);
+            return -1;
+        }
+        ctrl_msg_master_ingress_wait((void **)&view, 1);
+    }
+    return 0;
+}
+
+static int snapshot_domains_restore(const char **cur, const char *end, uint32_t domain_num) {
+    struct snapshot_zone *zones = NULL;
+    struct domin_info_update domain;
+    uint32_t i, zone_num = 0, last = 0;
+    int ret = 0;
+
+    for (i = 0; i < domain_num; ++i) {
+        const char *start = *cur;
+        if (snapshot_domain_decode(cur, end, &domain) < 0) {
+            ret = -1;
+            break;
+        }
+        //the records already are in the zone replace encoding, copy them as is
+        struct snapshot_zone *zone = snapshot_zone_get(&zones, &zone_num, &last, domain.zone_name);
+        snapshot_buf_put(&zone->buf, start, *cur - start);
+        zone->buf.domain_num++;
+    }
+
+    for (i = 0; i < zone_num; ++i) {
+        if (ret < 0) {
+            free(zones[i].buf.data);
+            continue;
+        }
+        struct zone_replace_update *update = zone_replace_finish(&zones[i].buf);
+        snprintf(update->zone_name, sizeof(update->zone_name), "%s", zones[i].zone_name);
+        update->cmsg.no_journal = 1;
+        ctrl_msg_master_ingress_wait((void **)&update, 1);
+    }
+    free(zones);
+    return ret;
+}
+
+int snapshot_restore(const char *path, uint64_t *generation) {
+    struct snapshot_header header;
+    struct stat st;
+    int ret = -1;
+
+    if (path == NULL || strlen(path) == 0) {
+        return 0;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_msg(LOG_INFO, "no snapshot %s to restore, errinfo=%s\n", path, strerror(errno));
+        return 0;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header)) {
+        log_msg(LOG_ERR, "snapshot %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        log_msg(LOG_ERR, "mmap snapshot %s failed, errno=%d, errinfo=%s\n", path, errno, strerror(errno));
+        return -1;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    memcpy(&header, addr, sizeof(header));
+    const char *cur = (const char *)addr + sizeof(header);
+    const char *end = cur + header.data_len;
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION) {
+        log_msg(LOG_ERR, "snapshot %s: bad magic or version %u\n", path, header.version);
+        goto out;
+    }
+    if ((uint64_t)header.data_len + sizeof(header) != (uint64_t)st.st_size
+            || rte_hash_crc(cur, header.data_len, 0) != header.checksum) {
+        log_msg(LOG_ERR, "snapshot %s: checksum err\n", path);
+        goto out;
+    }
+
+    if (snapshot_views_restore(&cur, end, header.view_num) < 0
+            || snapshot_domains_restore(&cur, end, header.domain_num) < 0) {
+        log_msg(LOG_ERR, "snapshot %s: restore failed\n", path);
+        goto out;
+    }
+    log_msg(LOG_INFO, "restore snapshot %s: %u views, %u domains, generation %lu, created at %lu\n", path,
+            header.view_num, header.domain_num, (unsigned long)header.generation, (unsigned long)header.create_time);
+    *generation = header.generation;
+    ret = 0;
+
+out:
+    munmap(addr, st.st_size);
+    return ret;
+}
+
+static void *thread_snapshot_dump(__attribute__((unused)) void *arg) {
+    while (1) {
+        sleep(snapshot_interval);
+        snapshot_dump(snapshot_path);
+    }
+    return NULL;
+}
+
+int snapshot_init(const char *path, uint32_t interval) {
+    pthread_t thread_id;
+
+    if (path == NULL || strlen(path) == 0 || interval == 0) {
+        return 0;
+    }
+    snapshot_path = strdup(path);
+    snapshot_interval = interval;
+    if (pthread_create(&thread_id, NULL, thread_snapshot_dump, NULL) != 0) {
+        log_msg(LOG_ERR, "create snapshot dump thread failed\n");
+        return -1;
+    }
+    pthread_setname_np(thread_id, "kdns_snapshot");
+    pthread_detach(thread_id);
+    return 0;
+}
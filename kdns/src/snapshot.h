@@ -0,0 +1,38 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+#include "db_update.h"
+
+/* record encoding shared by the snapshot and the journal */
+struct snapshot_buf {
+    char *data;
+    uint32_t len;
+    uint32_t size;
+    uint32_t view_num;
+    uint32_t domain_num;
+};
+
+void snapshot_buf_put(struct snapshot_buf *buf, const void *data, uint32_t len);
+
+/* size is the size of the field str lives in */
+void snapshot_buf_put_str(struct snapshot_buf *buf, const char *str, size_t size);
+
+int snapshot_get(const char **cur, const char *end, void *data, uint32_t len);
+
+int snapshot_get_str(const char **cur, const char *end, char *str, size_t size);
+
+void snapshot_domain_encode(struct snapshot_buf *buf, struct domin_info_update *update);
+
+int snapshot_domain_decode(const char **cur, const char *end, struct domin_info_update *update);
+
+/* write the domain and view registry of master to path */
+int snapshot_dump(const char *path);
+
+/* map the snapshot and send its views and zones to master, generation is the journal generation it covers */
+int snapshot_restore(const char *path, uint64_t *generation);
+
+/* dump to path every interval seconds in a background thread, interval 0 means only on demand */
+int snapshot_init(const char *path, uint32_t interval);
+
+#endif  /* _SNAPSHOT_H_ */
@@ -300,6 +300,20 @@ int tcp_process_init(void) {
     return 0;
 }
 
+int tcp_zone_replace(struct zone_replace_update *update) {
+    rte_rwlock_write_lock(&tcp_lock);
+    int ret = domaindata_zone_replace(tcp_kdns.db, update);
+    rte_rwlock_write_unlock(&tcp_lock);
+    return ret;
+}
+
+int tcp_domain_status_update(struct domain_status_update *update) {
+    rte_rwlock_write_lock(&tcp_lock);
+    int ret = domaindata_status_update(tcp_kdns.db, update);
+    rte_rwlock_write_unlock(&tcp_lock);
+    return ret;
+}
+
 int tcp_zones_reload(char *del_zones, char *add_zones) {
     //log_msg(LOG_INFO, "tcp reload zones: del: %s, add: %s.\n", del_zones, add_zones);
     rte_rwlock_write_lock(&tcp_lock);
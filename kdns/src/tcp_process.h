@@ -12,6 +12,10 @@ int tcp_process_init(void);
 
 int tcp_domian_databd_update(struct domin_info_update *update);
 
+int tcp_zone_replace(struct zone_replace_update *update);
+
+int tcp_domain_status_update(struct domain_status_update *update);
+
 int tcp_zones_reload(char *del_zones, char *add_zones);
 
 #endif  /*_TCP_PROCESS_H_*/
@@ -9,6 +9,7 @@
 #include "view_update.h"
 #include "kdns.h"
 #include "ctrl_msg.h"
+#include "journal.h"
 
 extern struct kdns dpdk_dns[MAX_CORES];
 
@@ -16,14 +17,11 @@ static view_tree_t *view_master_tree;
 static rte_rwlock_t view_master_lock;
 
 static int send_view_msg_to_master(struct view_info_update *msg) {
-    msg->cmsg.type = CTRL_MSG_TYPE_UPDATE_VIEW;
-    msg->cmsg.len = sizeof(struct view_info_update);
-
     return ctrl_msg_master_ingress((void **)&msg, 1) == 1 ? 0 : -1;
 }
 
 static struct view_info_update *do_view_parse(enum view_action action, json_t *json_data) {
-    struct view_info_update *update = xalloc_zero(sizeof(struct view_info_update));
+    struct view_info_update *update = ctrl_msg_alloc(CTRL_MSG_TYPE_UPDATE_VIEW, sizeof(struct view_info_update));
     update->action = action;
     const char *view_name;
 
@@ -47,7 +45,7 @@ static struct view_info_update *do_view_parse(enum view_action action, json_t *j
     return update;
 
 _parse_err:
-    free(update);
+    ctrl_msg_free(&update->cmsg);
     return NULL;
 }
 
@@ -213,38 +211,42 @@ err_out:
 }
 
 void view_query_slave_process(struct query *query, unsigned slave_lcore) {
-    view_value_t *data = view_find(dpdk_dns[slave_lcore].db->viewtree, (uint8_t *)&query->sip, 32);
-    if (data != VIEW_NO_NODE) {
-        snprintf(query->view_name, MAX_VIEW_NAME_LEN, "%s", data->view_name);
-    }
+    query->view_id = view_lookup(dpdk_dns[slave_lcore].db->viewtree, query->sip);
 }
 
 void view_query_master_process(struct query *query) {
     rte_rwlock_read_lock(&view_master_lock);
-    view_value_t *data = view_find(view_master_tree, (uint8_t *)&query->sip, 32);
-    if (data != VIEW_NO_NODE) {
-        snprintf(query->view_name, MAX_VIEW_NAME_LEN, "%s", data->view_name);
-    }
+    query->view_id = view_lookup(view_master_tree, query->sip);
     rte_rwlock_read_unlock(&view_master_lock);
 }
 
 static int view_msg_slave_process(ctrl_msg *msg, unsigned slave_lcore) {
     int ret = do_view_msg_update(dpdk_dns[slave_lcore].db->viewtree, (struct view_info_update *)msg);
-    free(msg);
+    ctrl_msg_free(msg);
     return ret;
 }
 
 static int view_msg_master_process(ctrl_msg *msg) {
+    journal_lock();
+    journal_append(msg);
     rte_rwlock_write_lock(&view_master_lock);
     int ret = do_view_msg_update(view_master_tree, (struct view_info_update *)msg);
     rte_rwlock_write_unlock(&view_master_lock);
-    free(msg);
+    journal_unlock();
+    ctrl_msg_free(msg);
     return ret;
 }
 
+void view_master_walk(void *arg, void (*callback)(void *, view_value_t *)) {
+    rte_rwlock_read_lock(&view_master_lock);
+    view_tree_dump(view_master_tree->root, arg, callback);
+    rte_rwlock_read_unlock(&view_master_lock);
+}
+
 void view_master_init(void) {
     ctrl_msg_reg(CTRL_MSG_TYPE_UPDATE_VIEW, CTRL_MSG_FLAG_MASTER_SYNC_SLAVE, view_msg_master_process, view_msg_slave_process);
 
     rte_rwlock_init(&view_master_lock);
     view_master_tree = view_tree_create();
+    view_lpm_master_init(view_master_tree);
 }
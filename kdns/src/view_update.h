@@ -32,6 +32,8 @@ void view_query_slave_process(struct query *query, unsigned slave_lcore);
 
 void view_query_master_process(struct query *query);
 
+void view_master_walk(void *arg, void (*callback)(void *, view_value_t *));
+
 void view_master_init(void);
 
 #endif
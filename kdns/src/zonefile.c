@@ -0,0 +1,611 @@
+/*
+ * zonefile.c
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "util.h"
+#include "kdns.h"
+#include "snapshot.h"
+#include "journal.h"
+#include "zonefile.h"
+
+#define ZONEFILE_MAX_TOKENS     (16)
+
+struct zonefile_parser {
+    const char *cur;
+    uint32_t line;
+    uint32_t entry_line;
+
+    int has_owner;
+    uint32_t ntokens;
+    char tokens[ZONEFILE_MAX_TOKENS][DB_MAX_NAME_LEN];
+
+    char origin[DB_MAX_NAME_LEN];
+    char owner[DB_MAX_NAME_LEN];
+    int has_ttl;            //without $TTL the records take the SOA minimum
+    uint32_t ttl;
+
+    char zone_name[DB_MAX_NAME_LEN];
+    uint8_t has_soa;
+    struct zone_soa_info soa;
+
+    uint32_t skipped;
+    struct snapshot_buf records;
+};
+
+/* the file each zone was last loaded from, a reload skips the files not changed since */
+struct zonefile_state {
+    char zone_name[DB_MAX_NAME_LEN];
+    char path[PATH_MAX];
+    struct timespec mtime;
+    off_t size;
+    struct zonefile_state *next;
+};
+
+static struct zonefile_state *zonefile_states;
+static pthread_mutex_t zonefile_states_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* \X is X itself, \DDD is the byte of decimal DDD. an escaped '.' inside a label is not supported */
+static int zonefile_escape_read(struct zonefile_parser *parser, const char **pos, char *c) {
+    const char *p = *pos + 1;
+
+    if (isdigit((unsigned char)p[0])) {
+        if (!isdigit((unsigned char)p[1]) || !isdigit((unsigned char)p[2])) {
+            log_msg(LOG_ERR, "zone file line %u: bad escape\n", parser->line);
+            return -1;
+        }
+        int val = (p[0] - '0') * 100 + (p[1] - '0') * 10 + (p[2] - '0');
+        if (val > UINT8_MAX) {
+            log_msg(LOG_ERR, "zone file line %u: bad escape\n", parser->line);
+            return -1;
+        }
+        *c = (char)val;
+        p += 3;
+    } else if (*p == '\0' || *p == '\n') {
+        log_msg(LOG_ERR, "zone file line %u: bad escape\n", parser->line);
+        return -1;
+    } else {
+        *c = *p++;
+    }
+    if (*c == '\0' || *c == '.') {
+        log_msg(LOG_ERR, "zone file line %u: escaped NUL or '.' is not supported\n", parser->line);
+        return -1;
+    }
+    *pos = p;
+    return 0;
+}
+
+/* read one entry, parentheses fold it over lines. return 1: got entry, 0: eof, -1: err */
+static int zonefile_entry_read(struct zonefile_parser *parser) {
+    const char *p = parser->cur;
+    int depth = 0;
+    int bol = 1;
+
+    parser->ntokens = 0;
+    parser->has_owner = 0;
+    while (*p) {
+        if (bol && depth == 0 && parser->ntokens == 0) {
+            parser->has_owner = (*p != ' ' && *p != '\t');
+        }
+        bol = 0;
+
+        if (*p == '\n') {
+            parser->line++;
+            p++;
+            bol = 1;
+            if (depth == 0 && parser->ntokens > 0) {
+                break;
+            }
+            continue;
+        }
+        if (*p == ' ' || *p == '\t' || *p == '\r') {
+            p++;
+            continue;
+        }
+        if (*p == ';') {
+            while (*p && *p != '\n') {
+                p++;
+            }
+            continue;
+        }
+        if (*p == '(') {
+            depth++;
+            p++;
+            continue;
+        }
+        if (*p == ')') {
+            if (depth == 0) {
+                log_msg(LOG_ERR, "zone file line %u: unbalanced ')'\n", parser->line);
+                return -1;
+            }
+            depth--;
+            p++;
+            continue;
+        }
+
+        if (parser->ntokens == ZONEFILE_MAX_TOKENS) {
+            log_msg(LOG_ERR, "zone file line %u: too many fields\n", parser->line);
+            return -1;
+        }
+        if (parser->ntokens == 0) {
+            parser->entry_line = parser->line;
+        }
+        char *tok = parser->tokens[parser->ntokens++];
+        size_t len = 0;
+        if (*p == '"') {
+            p++;
+            while (*p && *p != '"' && *p != '\n' && len < DB_MAX_NAME_LEN - 1) {
+                if (*p == '\\') {
+                    if (zonefile_escape_read(parser, &p, &tok[len++]) < 0) {
+                        return -1;
+                    }
+                    continue;
+                }
+                tok[len++] = *p++;
+            }
+            if (*p != '"') {
+                log_msg(LOG_ERR, "zone file line %u: unterminated or too long string\n", parser->line);
+                return -1;
+            }
+            p++;
+        } else {
+            while (*p && !isspace((unsigned char)*p) && *p != ';' && *p != '(' && *p != ')') {
+                if (len == DB_MAX_NAME_LEN - 1) {
+                    log_msg(LOG_ERR, "zone file line %u: field too long\n", parser->line);
+                    return -1;
+                }
+                if (*p == '\\') {
+                    if (zonefile_escape_read(parser, &p, &tok[len++]) < 0) {
+                        return -1;
+                    }
+                    continue;
+                }
+                tok[len++] = *p++;
+            }
+        }
+        tok[len] = '\0';
+    }
+    parser->cur = p;
+
+    if (depth) {
+        log_msg(LOG_ERR, "zone file line %u: unbalanced '('\n", parser->line);
+        return -1;
+    }
+    return parser->ntokens > 0 ? 1 : 0;
+}
+
+static int zonefile_name_resolve(struct zonefile_parser *parser, const char *name, char *out) {
+    char tmp[DB_MAX_NAME_LEN];
+    size_t len = strlen(name);
+    int ret;
+
+    if (strcmp(name, "@") == 0) {
+        ret = snprintf(tmp, sizeof(tmp), "%s", parser->origin);
+    } else if (len > 1 && name[len - 1] == '.') {
+        ret = snprintf(tmp, sizeof(tmp), "%.*s", (int)(len - 1), name);
+    } else if (len > 0 && name[len - 1] != '.' && parser->origin[0] != '\0') {
+        ret = snprintf(tmp, sizeof(tmp), "%s.%s", name, parser->origin);
+    } else {
+        log_msg(LOG_ERR, "zone file line %u: can not resolve name %s\n", parser->entry_line, name);
+        return -1;
+    }
+    if (ret <= 0 || ret >= (int)sizeof(tmp)) {
+        log_msg(LOG_ERR, "zone file line %u: bad name %s\n", parser->entry_line, name);
+        return -1;
+    }
+    memcpy(out, tmp, ret + 1);
+    return 0;
+}
+
+/* ttl in seconds, or with units like 1h30m */
+static int zonefile_ttl_parse(const char *str, uint32_t *ttl) {
+    uint64_t total = 0, num = 0;
+    const char *p;
+
+    if (!isdigit((unsigned char)*str)) {
+        return -1;
+    }
+    for (p = str; *p; ++p) {
+        if (isdigit((unsigned char)*p)) {
+            num = num * 10 + (*p - '0');
+            if (num > UINT32_MAX) {
+                return -1;
+            }
+            continue;
+        }
+        switch (tolower((unsigned char)*p)) {
+        case 's':
+            break;
+        case 'm':
+            num *= 60;
+            break;
+        case 'h':
+            num *= 3600;
+            break;
+        case 'd':
+            num *= 86400;
+            break;
+        case 'w':
+            num *= 604800;
+            break;
+        default:
+            return -1;
+        }
+        total += num;
+        num = 0;
+    }
+    total += num;
+    if (total > UINT32_MAX) {
+        return -1;
+    }
+    *ttl = (uint32_t)total;
+    return 0;
+}
+
+static int zonefile_u16_parse(struct zonefile_parser *parser, const char *str, uint16_t *val) {
+    char *end;
+
+    errno = 0;
+    unsigned long num = strtoul(str, &end, 10);
+    if (errno || *end != '\0' || !isdigit((unsigned char)*str) || num > UINT16_MAX) {
+        log_msg(LOG_ERR, "zone file line %u: bad number %s\n", parser->entry_line, str);
+        return -1;
+    }
+    *val = (uint16_t)num;
+    return 0;
+}
+
+static int zonefile_directive_process(struct zonefile_parser *parser) {
+    const char *name = parser->tokens[0];
+
+    if (strcasecmp(name, "$ORIGIN") == 0 && parser->ntokens == 2) {
+        return zonefile_name_resolve(parser, parser->tokens[1], parser->origin);
+    }
+    if (strcasecmp(name, "$TTL") == 0 && parser->ntokens == 2) {
+        if (zonefile_ttl_parse(parser->tokens[1], &parser->ttl) < 0) {
+            log_msg(LOG_ERR, "zone file line %u: bad ttl %s\n", parser->entry_line, parser->tokens[1]);
+            return -1;
+        }
+        parser->has_ttl = 1;
+        return 0;
+    }
+    log_msg(LOG_ERR, "zone file line %u: not support %s\n", parser->entry_line, name);
+    return -1;
+}
+
+static int zonefile_soa_process(struct zonefile_parser *parser, char (*rdata)[DB_MAX_NAME_LEN], uint32_t rdata_num) {
+    struct zone_soa_info *soa = &parser->soa;
+    uint32_t *values[] = {&soa->serial, &soa->refresh, &soa->retry, &soa->expire, &soa->minimum};
+    uint32_t i;
+
+    if (rdata_num != 7) {
+        log_msg(LOG_ERR, "zone file line %u: bad SOA record\n", parser->entry_line);
+        return -1;
+    }
+    if (parser->has_soa) {
+        log_msg(LOG_ERR, "zone file line %u: duplicate SOA record\n", parser->entry_line);
+        return -1;
+    }
+    if (parser->zone_name[0] == '\0') {
+        snprintf(parser->zone_name, sizeof(parser->zone_name), "%s", parser->owner);
+        if (parser->origin[0] == '\0') {
+            snprintf(parser->origin, sizeof(parser->origin), "%s", parser->owner);
+        }
+    } else if (strcasecmp(parser->zone_name, parser->owner) != 0) {
+        log_msg(LOG_ERR, "zone file line %u: SOA owner %s is not zone %s\n", parser->entry_line, parser->owner, parser->zone_name);
+        return -1;
+    }
+
+    if (zonefile_name_resolve(parser, rdata[0], soa->primary_ns) < 0
+            || zonefile_name_resolve(parser, rdata[1], soa->mailbox) < 0) {
+        return -1;
+    }
+    for (i = 0; i < 5; ++i) {
+        if (zonefile_ttl_parse(rdata[i + 2], values[i]) < 0) {
+            log_msg(LOG_ERR, "zone file line %u: bad SOA number %s\n", parser->entry_line, rdata[i + 2]);
+            return -1;
+        }
+    }
+    parser->has_soa = 1;
+    return 0;
+}
+
+static int zonefile_entry_process(struct zonefile_parser *parser) {
+    char (*tokens)[DB_MAX_NAME_LEN] = parser->tokens;
+    uint32_t idx = 0, ttl = parser->has_ttl ? parser->ttl : parser->soa.minimum;
+    struct domin_info_update rec;
+
+    if (parser->has_owner && tokens[0][0] == '$') {
+        return zonefile_directive_process(parser);
+    }
+
+    if (parser->has_owner) {
+        if (zonefile_name_resolve(parser, tokens[idx++], parser->owner) < 0) {
+            return -1;
+        }
+    } else if (parser->owner[0] == '\0') {
+        log_msg(LOG_ERR, "zone file line %u: no owner name\n", parser->entry_line);
+        return -1;
+    }
+
+    /* [ttl] [class] in any order */
+    for (; idx < parser->ntokens; ++idx) {
+        if (zonefile_ttl_parse(tokens[idx], &ttl) == 0 || strcasecmp(tokens[idx], "IN") == 0) {
+            continue;
+        }
+        if (strcasecmp(tokens[idx], "CH") == 0 || strcasecmp(tokens[idx], "HS") == 0 || strcasecmp(tokens[idx], "CS") == 0) {
+            parser->skipped++;
+            return 0;
+        }
+        break;
+    }
+    if (idx == parser->ntokens) {
+        log_msg(LOG_ERR, "zone file line %u: no record type\n", parser->entry_line);
+        return -1;
+    }
+
+    const char *type = tokens[idx++];
+    char (*rdata)[DB_MAX_NAME_LEN] = &tokens[idx];
+    uint32_t rdata_num = parser->ntokens - idx;
+
+    if (strcasecmp(type, "SOA") == 0) {
+        return zonefile_soa_process(parser, rdata, rdata_num);
+    }
+    if (!parser->has_soa) {
+        log_msg(LOG_ERR, "zone file line %u: zone must start with SOA record\n", parser->entry_line);
+        return -1;
+    }
+    if (!domain_name_in_zone(parser->owner, parser->zone_name)) {
+        log_msg(LOG_ERR, "zone file line %u: owner %s is not in zone %s\n", parser->entry_line, parser->owner, parser->zone_name);
+        return -1;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.action = DOMAN_ACTION_ADD;
+    rec.ttl = ttl;
+    memcpy(rec.view_name, DEFAULT_VIEW_NAME, strlen(DEFAULT_VIEW_NAME));
+    snprintf(rec.zone_name, sizeof(rec.zone_name), "%s", parser->zone_name);
+    snprintf(rec.domain_name, sizeof(rec.domain_name), "%s", parser->owner);
+
+    if (strcasecmp(type, "A") == 0 || strcasecmp(type, "AAAA") == 0) {
+        struct in6_addr addr;
+        rec.type = (type[1] == '\0') ? TYPE_A : TYPE_AAAA;
+        if (rdata_num != 1 || inet_pton(rec.type == TYPE_A ? AF_INET : AF_INET6, rdata[0], &addr) <= 0) {
+            log_msg(LOG_ERR, "zone file line %u: bad %s record\n", parser->entry_line, type);
+            return -1;
+        }
+        snprintf(rec.host, sizeof(rec.host), "%s", rdata[0]);
+    } else if (strcasecmp(type, "CNAME") == 0 || strcasecmp(type, "PTR") == 0) {
+        rec.type = (toupper((unsigned char)type[0]) == 'C') ? TYPE_CNAME : TYPE_PTR;
+        if (rdata_num != 1 || zonefile_name_resolve(parser, rdata[0], rec.host) < 0) {
+            log_msg(LOG_ERR, "zone file line %u: bad %s record\n", parser->entry_line, type);
+            return -1;
+        }
+    } else if (strcasecmp(type, "SRV") == 0) {
+        rec.type = TYPE_SRV;
+        if (rdata_num != 4 || zonefile_u16_parse(parser, rdata[0], &rec.prio) < 0
+                || zonefile_u16_parse(parser, rdata[1], &rec.weight) < 0
+                || zonefile_u16_parse(parser, rdata[2], &rec.port) < 0
+                || zonefile_name_resolve(parser, rdata[3], rec.host) < 0) {
+            log_msg(LOG_ERR, "zone file line %u: bad SRV record\n", parser->entry_line);
+            return -1;
+        }
+    } else {
+        //NS and the others are not served by kdns
+        parser->skipped++;
+        return 0;
+    }
+
+    uint32_t i;
+    for (i = 0; type[i] && i < sizeof(rec.type_str) - 1; ++i) {
+        rec.type_str[i] = toupper((unsigned char)type[i]);
+    }
+    zone_replace_add(&parser->records, &rec);
+    return 0;
+}
+
+struct zone_replace_update *zonefile_parse(const char *zone_name, const char *data) {
+    int ret;
+    struct zonefile_parser *parser = xalloc_zero(sizeof(struct zonefile_parser));
+
+    parser->cur = data;
+    parser->line = 1;
+    zone_replace_init(&parser->records);
+    if (zone_name) {
+        snprintf(parser->zone_name, sizeof(parser->zone_name), "%s", zone_name);
+        snprintf(parser->origin, sizeof(parser->origin), "%s", zone_name);
+    }
+
+    while ((ret = zonefile_entry_read(parser)) > 0) {
+        if (zonefile_entry_process(parser) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret == 0 && !parser->has_soa) {
+        log_msg(LOG_ERR, "zone file has no SOA record\n");
+        ret = -1;
+    }
+    if (ret < 0) {
+        free(parser->records.data);
+        free(parser);
+        return NULL;
+    }
+    struct zone_replace_update *update = zone_replace_finish(&parser->records);
+    memcpy(update->zone_name, parser->zone_name, sizeof(update->zone_name));
+    update->has_soa = parser->has_soa;
+    update->soa = parser->soa;
+    if (parser->skipped) {
+        log_msg(LOG_INFO, "zone %s: skipped %u records of unsupported type or class\n", update->zone_name, parser->skipped);
+    }
+    free(parser);
+    return update;
+}
+
+static struct zonefile_state *zonefile_state_find(const char *zone_name) {
+    struct zonefile_state *state;
+
+    for (state = zonefile_states; state; state = state->next) {
+        if (strcasecmp(state->zone_name, zone_name) == 0) {
+            return state;
+        }
+    }
+    return NULL;
+}
+
+static int zonefile_unchanged(const char *zone_name, const char *path, const struct stat *st) {
+    int ret;
+
+    pthread_mutex_lock(&zonefile_states_lock);
+    struct zonefile_state *state = zonefile_state_find(zone_name);
+    ret = state != NULL && strcmp(state->path, path) == 0 && state->size == st->st_size
+            && state->mtime.tv_sec == st->st_mtim.tv_sec && state->mtime.tv_nsec == st->st_mtim.tv_nsec;
+    pthread_mutex_unlock(&zonefile_states_lock);
+    return ret;
+}
+
+static void zonefile_state_set(const char *zone_name, const char *path, const struct stat *st) {
+    pthread_mutex_lock(&zonefile_states_lock);
+    struct zonefile_state *state = zonefile_state_find(zone_name);
+    if (state == NULL) {
+        state = xalloc_zero(sizeof(struct zonefile_state));
+        snprintf(state->zone_name, sizeof(state->zone_name), "%s", zone_name);
+        state->next = zonefile_states;
+        zonefile_states = state;
+    }
+    snprintf(state->path, sizeof(state->path), "%s", path);
+    state->mtime = st->st_mtim;
+    state->size = st->st_size;
+    pthread_mutex_unlock(&zonefile_states_lock);
+}
+
+int zonefile_load(const char *zone_name, const char *path, int startup) {
+    struct timeval start, end;
+    struct stat st;
+    gettimeofday(&start, NULL);
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        log_msg(LOG_ERR, "open zone file %s failed, errno=%d, errinfo=%s\n", path, errno, strerror(errno));
+        return -1;
+    }
+    if (fstat(fileno(fp), &st) < 0) {
+        log_msg(LOG_ERR, "stat zone file %s failed, errno=%d, errinfo=%s\n", path, errno, strerror(errno));
+        fclose(fp);
+        return -1;
+    }
+    if (zonefile_unchanged(zone_name, path, &st)) {
+        log_msg(LOG_INFO, "zone file %s of zone %s is not changed, skip it\n", path, zone_name);
+        fclose(fp);
+        return 0;
+    }
+    long size = st.st_size;
+
+    char *data = xalloc(size + 1);
+    if (fread(data, 1, size, fp) != (size_t)size) {
+        log_msg(LOG_ERR, "read zone file %s failed\n", path);
+        free(data);
+        fclose(fp);
+        return -1;
+    }
+    data[size] = '\0';
+    fclose(fp);
+
+    struct zone_replace_update *update = zonefile_parse(zone_name, data);
+    free(data);
+    if (update == NULL || zone_replace_check(update) < 0) {
+        log_msg(LOG_ERR, "load zone file %s failed\n", path);
+        if (update) {
+            ctrl_msg_free(&update->cmsg);
+        }
+        return -1;
+    }
+
+    //a runtime reload is journaled like a posted zone file, a later api change must not outlive it in a replay
+    uint32_t update_num = update->update_num;
+    update->cmsg.no_journal = startup;
+    if (startup) {
+        ctrl_msg_master_ingress_wait((void **)&update, 1);
+    } else if (ctrl_msg_master_ingress((void **)&update, 1) != 1) {
+        log_msg(LOG_ERR, "load zone file %s: send msg to master failed\n", path);
+        return -1;
+    }
+    zonefile_state_set(zone_name, path, &st);
+
+    gettimeofday(&end, NULL);
+    log_msg(LOG_INFO, "load zone file %s: zone %s, %u records, cost %ld ms\n", path, zone_name, update_num,
+            (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000);
+    return 0;
+}
+
+static void zonefiles_each_load(char *zone_files, int startup) {
+    char *name, *path, *tmp;
+
+    name = strtok_r(zone_files, ",", &tmp);
+    while (name) {
+        path = strchr(name, ':');
+        if (path == NULL) {
+            log_msg(LOG_ERR, "bad zone-files item %s, should be zone:path\n", name);
+        } else {
+            *path++ = '\0';
+            if (startup && journal_zone_replaced(name)) {
+                log_msg(LOG_INFO, "zone %s is replaced by the journal, skip its file %s\n", name, path);
+            } else {
+                zonefile_load(name, path, startup);
+            }
+        }
+        name = strtok_r(0, ",", &tmp);
+    }
+}
+
+static void *thread_zonefiles_load(void *arg) {
+    char *zone_files = (char *)arg;
+
+    zonefiles_each_load(zone_files, 0);
+    free(zone_files);
+    return NULL;
+}
+
+int zonefiles_startup_load(const char *zone_files) {
+    if (zone_files == NULL || strlen(zone_files) == 0) {
+        return 0;
+    }
+
+    char *arg = strdup(zone_files);
+    zonefiles_each_load(arg, 1);
+    free(arg);
+    return 0;
+}
+
+int zonefiles_load(const char *zone_files) {
+    pthread_t thread_id;
+
+    if (zone_files == NULL || strlen(zone_files) == 0) {
+        return 0;
+    }
+
+    char *arg = strdup(zone_files);
+    if (pthread_create(&thread_id, NULL, thread_zonefiles_load, (void *)arg) != 0) {
+        log_msg(LOG_ERR, "create zone files load thread failed\n");
+        free(arg);
+        return -1;
+    }
+    pthread_setname_np(thread_id, "kdns_zonefile");
+    pthread_detach(thread_id);
+    return 0;
+}
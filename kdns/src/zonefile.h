@@ -0,0 +1,20 @@
+#ifndef _ZONEFILE_H_
+#define _ZONEFILE_H_
+
+#include "db_update.h"
+
+/* parse a RFC 1035 master file, zone_name NULL means taking the zone from the leading SOA */
+struct zone_replace_update *zonefile_parse(const char *zone_name, const char *data);
+
+/* a file whose mtime and size did not change since its last load is skipped.
+ * startup: called on master before the journal replay, queue the msg without dropping it and do not journal it */
+int zonefile_load(const char *zone_name, const char *path, int startup);
+
+/* zone_files: "zone:path,zone:path", loaded in a background thread */
+int zonefiles_load(const char *zone_files);
+
+/* load on master after journal_scan and before the replay, so the journaled api changes stay on top.
+ * a zone the journal replaces is skipped, its journaled replace is newer than the file */
+int zonefiles_startup_load(const char *zone_files);
+
+#endif  /* _ZONEFILE_H_ */